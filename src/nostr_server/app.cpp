@@ -12,12 +12,15 @@
 #include "kinds.h"
 
 #include "whitelist_impl.h"
+#include "count_index_impl.h"
 #include "routing_imp.h"
 
 #include <coroserver/http_ws_server.h>
 #include <coroserver/strutils.h>
 #include <docdb/json.h>
 #include <docdb/aggregator.h>
+#include <bit>
+#include <cstring>
 #include <sstream>
 #include <shared/logOutput.h>
 
@@ -35,6 +38,39 @@ const std::string App::software_version = PROJECT_NOSTR_SERVER_VERSION;
 
 
 
+///Change of stored event made by the current thread, applied after commit
+struct StorageChange {
+    docdb::DocID id;
+    Event ev;
+    bool removed;
+};
+static thread_local std::vector<StorageChange> storage_changes;
+///Ids of added (false) and removed (true) events, applied after commit
+static thread_local std::vector<std::pair<Event::ID, bool> > id_changes;
+///Pubkeys which karma can be changed, reloaded after commit
+static thread_local std::vector<Event::Pubkey> karma_changes;
+
+///Emit of WhiteListIndexFn, which only collects keys
+/**
+ * Every key looks like existing local user, so all keys, which the
+ * function can update, are collected
+ */
+template<bool is_erase>
+struct KarmaKeyCollector {
+    static constexpr bool erase = is_erase;
+    struct Value {
+        Karma k = {0,0,0,0,true};
+        explicit operator bool() const {return true;}
+        Karma &operator*() {return k;}
+        Karma *operator->() {return &k;}
+        void put(const Karma &) {}
+    };
+    Value operator()(const Event::Pubkey &pk) const {
+        karma_changes.push_back(pk);
+        return {};
+    }
+};
+
 App::App(const Config &cfg)
         :static_page(cfg.web_document_root, "index.html")
         ,_db(docdb::Database::create(cfg.database_path, cfg.leveldb_options))
@@ -44,27 +80,93 @@ App::App(const Config &cfg)
         ,_open_metrics_conf(cfg.metric)
         ,_omcoll(std::make_shared<telemetry::open_metrics::Collector>())
         ,_storage(_db,"events")
+        ,_flat_storage(_db, _storage.get_kid(), docdb::Direction::forward, {})
+        ,_view_storage(_db, _storage.get_kid(), docdb::Direction::forward, {})
+        ,_event_cache(cfg.event_cache_size)
+        ,_result_cache(cfg.result_cache_size)
+        ,_recent(cfg.recent_kinds, cfg.recent_count, cfg.recent_max_age)
         ,_index_by_id(_storage,"ids")
         ,_index_pubkey_time(_storage,"pubkey_hash_time")
         ,_index_replaceable(_storage, "replaceable")
         ,_index_tag_value_time(_storage, "tag_value_time")
         ,_index_kind_time(_storage, "kind_time")
+        ,_index_pubkey_kind_time(_storage, "pubkey_kind_time")
+        ,_index_tag_value_kind_time(_storage, "tag_value_kind_time")
         ,_index_time(_storage, "time")
         ,_index_fulltext(_storage, "fulltext")
         ,_index_whitelist(_storage, "karma")
         ,_index_attachments(_storage,"attachments")
         ,_index_routing(_storage, "routing")
         ,_index_nip05(_storage, "nip05")
+        ,_index_counts(_storage, "counts")
+        ,_explain_queries(cfg.query_explain)
+        ,_count_max_error(cfg.count_max_error)
+        ,_store_json(cfg.store_json)
         ,_gc_is_clear(std::make_shared<std::atomic_flag>())
+        ,_dispatcher(static_cast<unsigned int>(std::max(cfg.threads, 1)))
+        ,_query_executor(cfg.query_threads, _dispatcher)
+        ,_verifier(cfg.verify_threads, _dispatcher)
+        ,_writer(writer_callbacks(), _dispatcher, cfg.write_batch, std::chrono::microseconds(cfg.write_latency_us))
 {
+    if (_count_max_error > 0) _index_time_counts.emplace(_storage, "time_counts");
     _storage.register_transaction_observer(autocompact());
+    _storage.register_transaction_observer([this](docdb::Batch &, const Storage::Update &up){
+        if (up.old_doc_id) _event_cache.invalidate(up.old_doc_id);
+        const Event *ev = up.old_doc?std::get_if<Event>(up.old_doc):nullptr;
+        const Event *nev = up.new_doc?std::get_if<Event>(up.new_doc):nullptr;
+        //rewritten event (migration) doesn't change results
+        if (ev && nev && ev->id == nev->id) return;
+        if (_id_filter.is_enabled()) {
+            if (ev) id_changes.push_back({ev->id, true});
+            if (nev) id_changes.push_back({nev->id, false});
+        }
+        WhiteListIndexFn karma_fn;
+        if (up.old_doc) karma_fn(KarmaKeyCollector<true>(), *up.old_doc);
+        if (up.new_doc) karma_fn(KarmaKeyCollector<false>(), *up.new_doc);
+        if (ev && (_result_cache.is_enabled() || _recent.is_hot(ev->kind))) {
+            storage_changes.push_back({up.old_doc_id, *ev, true});
+        }
+        if (nev && _recent.is_hot(nev->kind)) {
+            storage_changes.push_back({up.new_doc_id, *nev, false});
+        }
+    });
+    if (cfg.store_json && cfg.migrate_json) {
+        ondra_shared::LogObject lg("Migration");
+        auto s = migrate_json(lg);
+        if (s) {
+            lg.progress("Done $1 event(s) migrated", s);
+        } else {
+            //the database is scanned on every start until the option is disabled
+            lg.warning("Nothing to migrate, set migrate_json=false to skip the scan");
+        }
+    }
+    if (cfg.id_filter) {
+        ondra_shared::LogObject lg("IdFilter");
+        auto s = load_id_filter();
+        lg.progress("Loaded $1 id(s)", s);
+    }
+    if (_recent.is_enabled()) {
+        ondra_shared::LogObject lg("RecentEvents");
+        auto s = load_recent_events(cfg.recent_kinds);
+        lg.progress("Loaded $1 recent event(s)", s);
+    }
     if (cfg.metric.enable) {
         register_scavengers(*_omcoll);
         _omcoll->make_active();
         _dbsensor.enable(_db);
         _storage_sensor.enable(StorageSensor{&_storage});
+        _query_sensor.enable(QueryExecutorSensor{&_query_executor});
+        _cache_sensor.enable(EventCacheSensor{&_event_cache});
+        _result_cache_sensor.enable(ResultCacheSensor{&_result_cache});
+        _recent_sensor.enable(RecentEventsSensor{&_recent});
+        _writer_sensor.enable(EventWriterSensor{&_writer});
+        _id_filter_sensor.enable(IdFilterSensor{&_id_filter});
+    }
+    {
+        ondra_shared::LogObject lg("Karma");
+        auto s = load_karma();
+        lg.progress("Loaded $1 pubkey(s)", s);
     }
-    _empty_database = _index_whitelist.select_all().empty();
 }
 
 
@@ -164,6 +266,23 @@ void App::init_handlers(coroserver::http::Server &server) {
 }
 
 
+///First bytes of the pubkey stored in the covering payload
+static std::uint64_t author_prefix(const Event::Pubkey &pk) {
+    std::uint64_t r = 0;
+    std::memcpy(&r, pk.data(), std::min(sizeof(r), pk.size()));
+    return r;
+}
+
+///Second hash of the tag value, rejects collisions of the hash in the key (FNV-1a)
+static std::uint32_t tag_value_check(std::string_view value) {
+    std::uint32_t h = 2166136261U;
+    for (char c: value) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 16777619U;
+    }
+    return h;
+}
+
 template<typename Emit>
 void App::IndexByIdFn::operator ()(Emit emit, const EventOrAttachment &evatt) const {
     if (!std::holds_alternative<Event>(evatt)) return;
@@ -194,7 +313,7 @@ template<typename Emit>
 void App::IndexByPubkeyHashTimeFn::operator ()(Emit emit, const EventOrAttachment &evatt) const {
     if (!std::holds_alternative<Event>(evatt)) return;
     const Event &ev = std::get<Event>(evatt);
-    emit({ev.author, ev.created_at});
+    emit({ev.author, ev.created_at}, docdb::Row(ev.kind));
 }
 
 template<typename Emit>
@@ -205,7 +324,7 @@ void App::IndexTagValueHashTimeFn::operator ()(Emit emit, const EventOrAttachmen
     for (const auto &t: ev.tags) {
         if (t.tag.size() == 1) {
             std::size_t h = hasher(t.content);
-            emit({t.tag[0],h, ev.created_at});
+            emit({t.tag[0],h, ev.created_at}, docdb::Row(ev.kind, author_prefix(ev.author), tag_value_check(t.content)));
         }
     }
 }
@@ -214,7 +333,27 @@ template<typename Emit>
 void App::IndexKindTimeFn::operator ()(Emit emit, const EventOrAttachment &evatt) const {
     if (!std::holds_alternative<Event>(evatt)) return;
     const Event &ev = std::get<Event>(evatt);
-    emit({ev.kind,ev.created_at});
+    emit({ev.kind,ev.created_at}, docdb::Row(author_prefix(ev.author)));
+}
+
+template<typename Emit>
+void App::IndexPubkeyKindTimeFn::operator ()(Emit emit, const EventOrAttachment &evatt) const {
+    if (!std::holds_alternative<Event>(evatt)) return;
+    const Event &ev = std::get<Event>(evatt);
+    emit({ev.author, ev.kind, ev.created_at});
+}
+
+template<typename Emit>
+void App::IndexTagValueKindTimeFn::operator ()(Emit emit, const EventOrAttachment &evatt) const {
+    if (!std::holds_alternative<Event>(evatt)) return;
+    const Event &ev = std::get<Event>(evatt);
+    std::hash<std::string_view> hasher;
+    for (const auto &t: ev.tags) {
+        if (t.tag.size() == 1) {
+            std::size_t h = hasher(t.content);
+            emit({t.tag[0],h, ev.kind, ev.created_at}, docdb::Row(author_prefix(ev.author), tag_value_check(t.content)));
+        }
+    }
 }
 
 template<typename Emit>
@@ -283,20 +422,35 @@ docdb::DocID App::find_replacable(std::string_view pubkey, unsigned int kind, st
 
 bool App::check_whitelist(const Event::Pubkey &k) const
 {
-    if (_empty_database) {
-        _empty_database = _index_whitelist.select_all().empty();
-        if (_empty_database) return true;
-    }
-    auto r = _index_whitelist.find(k);
+    //empty database accepts everyone
+    if (_karma.empty()) return true;
+    auto r = _karma.find(k);
     if (!r) return false;
-    return r->get_score() > 0;
+    return r->score > 0;
 }
 
 int App::get_karma(const Event::Pubkey &k) const
 {
-    auto r = _index_whitelist.find(k);
+    auto r = _karma.find(k);
     if (!r) return 0;
-    return r->get_score();
+    return r->score;
+}
+
+std::optional<KarmaTable::Value> App::read_karma(const Event::Pubkey &k) const {
+    auto r = _index_whitelist.find(k);
+    if (!r) return std::nullopt;
+    return KarmaTable::Value{r->get_score(), r->local};
+}
+
+std::size_t App::load_karma() {
+    std::size_t cnt = 0;
+    for (const auto &row: _index_whitelist.select_all()) {
+        auto [pk] = row.key.get<Event::Pubkey>();
+        const Karma &k = row.value;
+        _karma.set(pk, KarmaTable::Value{k.get_score(), k.local});
+        ++cnt;
+    }
+    return cnt;
 }
 
 
@@ -369,112 +523,731 @@ static auto searchShortenID(const Index &idx, const Def &def) {
     return idx.select_between(from,to);
 }
 
-void App::find_in_index(RecordSetCalculator &calc, const std::vector<Filter> &filters) const {
-    std::hash<std::string_view> hasher;
-    calc.clear();
-
-    docdb::PSnapshot snap = _storage.get_db()->make_snapshot();
+template<typename Recordset>
+static std::size_t count_rows(Recordset &&rs, std::size_t limit) {
+    std::size_t n = 0;
+    for (auto iter = rs.begin(); iter != rs.end() && n < limit; ++iter) ++n;
+    return n;
+}
 
-    calc.push(calc.empty_set());
-    for (const auto &f: filters) {
-        bool need_time = true;
-        calc.push(calc.all_items_set());
-        do {
-            if (!f.ft_search.empty()) {
-                std::vector<WordToken> wt;
-                tokenize_text(f.ft_search, wt);
-                calc.push(calc.empty_set());
-                for (const WordToken &tk: wt) {
-                   calc.push(_index_fulltext.select(docdb::prefix(tk.first)),
-                           fulltext_relevance_ordering(tk.first));
-                   calc.OR(merge_relevance);
-                }
-                calc.AND(merge_relevance);
+void App::collect_access_paths(const Filter &f, const docdb::PSnapshot &snap, std::vector<AccessPath> &paths) const {
+    std::hash<std::string_view> hasher;
+    paths.clear();
+    //estimate is count of rows of the path. Ranges are probed until plan_probe_limit
+    //rows are read or plan_probe_ranges ranges are probed, other ranges are extrapolated
+    auto probe = [](AccessPath &p, std::size_t ranges, auto &&count_range) {
+        std::size_t probed = 0;
+        while (probed < ranges && probed < plan_probe_ranges && p.estimate < plan_probe_limit) {
+            p.estimate += count_range(probed, plan_probe_limit - p.estimate);
+            ++probed;
+        }
+        if (probed < ranges && p.estimate < plan_probe_limit) {
+            p.estimate = std::min(p.estimate * ranges / probed, plan_probe_limit);
+        }
+    };
+    if (!f.ft_search.empty()) {
+        //fulltext is not tested by the filter, so it is always used
+        paths.push_back({"search", 0, true, [this, &f](RecordSetCalculator &calc){
+            std::vector<WordToken> wt;
+            tokenize_text(f.ft_search, wt);
+            calc.push(calc.empty_set());
+            for (const WordToken &tk: wt) {
+               calc.push(_index_fulltext.select(docdb::prefix(tk.first)),
+                       fulltext_relevance_ordering(tk.first));
+               calc.OR(merge_relevance);
             }
-            if (calc.is_top_empty()) break;;
-            if (!f.ids.empty()) {
-               calc.push(calc.empty_set());
-               for (const auto &a: f.ids) {
-                   if (a.second != a.first.size()) {
-                        calc.push(searchShortenID(_index_by_id.get_snapshot(snap), a),
-                            unique_index_ordering);
-                        calc.OR(merge_relevance);
-                   } else {
-                        auto s = calc.empty_set();
+        }});
+    }
+    if (!f.ids.empty()) {
+        AccessPath &p = paths.emplace_back(AccessPath{"ids", 0, false, [this, &f, snap](RecordSetCalculator &calc){
+           calc.push(calc.empty_set());
+           for (const auto &a: f.ids) {
+               if (a.second != a.first.size()) {
+                    calc.push(searchShortenID(_index_by_id.get_snapshot(snap), a),
+                        unique_index_ordering);
+                    calc.OR(merge_relevance);
+               } else {
+                    auto s = calc.empty_set();
+                    //unknown ids are not searched in the index
+                    if (_id_filter.may_contain(a.first)) {
                         auto row = _index_by_id.find(a.first);
                         if (row) {
                             auto [time] = row->value.get<std::time_t>();
                             s.push_back({row->id,unique_key_value_ordering(time)});
                         }
-                        calc.push(std::move(s));
-                        calc.OR(merge_relevance);
-                   }
-               }
-               calc.AND(merge_relevance);
-               if (calc.is_top_empty()) break;
-            }
-            if (!f.authors.empty()) {
-                calc.push(calc.empty_set());
-                for (const auto &a: f.authors) {
-                    if (a.second != a.first.size()) {
-                        calc.push(searchShortenID(_index_pubkey_time.get_snapshot(snap), a),
-                            multi_index_ordering<Event::Pubkey>());
-                        calc.OR(merge_relevance);
-                    } else {
-                        docdb::Key from(a.first);
-                        docdb::Key to(a.first);
-                        append_time(f, from, to);
-                        need_time = false;
-                        calc.push(_index_pubkey_time.get_snapshot(snap).select_between(from, to),
-                                multi_index_ordering<std::size_t>());
-                        calc.OR(merge_relevance);
                     }
+                    calc.push(std::move(s));
+                    calc.OR(merge_relevance);
+               }
+           }
+        }});
+        probe(p, f.ids.size(), [&](std::size_t i, std::size_t limit) -> std::size_t {
+            const auto &a = f.ids[i];
+            return a.second != a.first.size()?count_rows(searchShortenID(_index_by_id.get_snapshot(snap), a), limit):1;
+        });
+    }
+    if (!f.authors.empty()) {
+        AccessPath &p = paths.emplace_back(AccessPath{"authors", 0, false, [this, &f, snap](RecordSetCalculator &calc){
+            calc.push(calc.empty_set());
+            for (const auto &a: f.authors) {
+                if (a.second != a.first.size()) {
+                    calc.push(searchShortenID(_index_pubkey_time.get_snapshot(snap), a),
+                        multi_index_ordering<Event::Pubkey>());
+                    calc.OR(merge_relevance);
+                } else {
+                    docdb::Key from(a.first);
+                    docdb::Key to(a.first);
+                    append_time(f, from, to);
+                    calc.push(_index_pubkey_time.get_snapshot(snap).select_between(from, to),
+                            multi_index_ordering<std::size_t>());
+                    calc.OR(merge_relevance);
                 }
-                calc.AND(merge_relevance);
-                if (calc.is_top_empty()) break;
             }
-            for(const auto &[t, contents]:f.tags) {
-                calc.push(calc.empty_set());
-                for (const auto &x: contents) {
-                    std::size_t h = hasher(x);
-                    docdb::Key from(t,h);
-                    docdb::Key to(t,h);
-                    append_time(f,from, to);
-                    need_time = false;
-                    calc.push(_index_tag_value_time.get_snapshot(snap).select_between(from, to),
-                            multi_index_ordering<unsigned char, std::size_t>());
+        }});
+        p.timed = std::all_of(f.authors.begin(), f.authors.end(), [](const auto &a){
+            return a.second == a.first.size();
+        });
+        p.covers = cover_authors;
+        probe(p, f.authors.size(), [&](std::size_t i, std::size_t limit) {
+            const auto &a = f.authors[i];
+            if (a.second != a.first.size()) {
+                return count_rows(searchShortenID(_index_pubkey_time.get_snapshot(snap), a), limit);
+            }
+            docdb::Key from(a.first);
+            docdb::Key to(a.first);
+            append_time(f, from, to);
+            return count_rows(_index_pubkey_time.get_snapshot(snap).select_between(from, to), limit);
+        });
+    }
+    for(const auto &tg: f.tags) {
+        AccessPath &p = paths.emplace_back(AccessPath{"tag", 0, false, [this, &f, &tg, snap, hasher](RecordSetCalculator &calc){
+            const auto &[t, contents] = tg;
+            calc.push(calc.empty_set());
+            for (const auto &x: contents) {
+                std::size_t h = hasher(x);
+                docdb::Key from(t,h);
+                docdb::Key to(t,h);
+                append_time(f,from, to);
+                calc.push(_index_tag_value_time.get_snapshot(snap).select_between(from, to),
+                        multi_index_ordering<unsigned char, std::size_t>());
+                calc.OR(merge_relevance);
+            }
+        }});
+        p.tag = tg.first;
+        p.timed = true;
+        p.covers = cover_tag;
+        p.inexact = true;
+        probe(p, tg.second.size(), [&](std::size_t i, std::size_t limit) {
+            std::size_t h = hasher(tg.second[i]);
+            docdb::Key from(tg.first,h);
+            docdb::Key to(tg.first,h);
+            append_time(f,from, to);
+            return count_rows(_index_tag_value_time.get_snapshot(snap).select_between(from, to), limit);
+        });
+    }
+    if (!f.kinds.empty()) {
+        AccessPath &p = paths.emplace_back(AccessPath{"kinds", 0, false, [this, &f, snap](RecordSetCalculator &calc){
+            calc.push(calc.empty_set());
+            for (const auto &a: f.kinds) {
+                docdb::Key from(a);
+                docdb::Key to(a);
+                append_time(f, from, to);
+                calc.push(_index_kind_time.get_snapshot(snap).select_between(from, to),
+                        multi_index_ordering<unsigned int>());
+                calc.OR(merge_relevance);
+            }
+        }});
+        p.timed = true;
+        p.covers = cover_kinds;
+        probe(p, f.kinds.size(), [&](std::size_t i, std::size_t limit) {
+            docdb::Key from(f.kinds[i]);
+            docdb::Key to(f.kinds[i]);
+            append_time(f, from, to);
+            return count_rows(_index_kind_time.get_snapshot(snap).select_between(from, to), limit);
+        });
+    }
+    //compound indexes avoid AND with the large kind_time ranges
+    bool full_authors = !f.authors.empty() && std::all_of(f.authors.begin(), f.authors.end(), [](const auto &a){
+        return a.second == a.first.size();
+    });
+    if (full_authors && !f.kinds.empty() && f.authors.size() * f.kinds.size() <= compound_max_ranges) {
+        AccessPath &p = paths.emplace_back(AccessPath{"authors+kinds", 0, false, [this, &f, snap](RecordSetCalculator &calc){
+            calc.push(calc.empty_set());
+            for (const auto &a: f.authors) {
+                for (const auto &k: f.kinds) {
+                    docdb::Key from(a.first, k);
+                    docdb::Key to(a.first, k);
+                    append_time(f, from, to);
+                    calc.push(_index_pubkey_kind_time.get_snapshot(snap).select_between(from, to),
+                            multi_index_ordering<Event::Pubkey, unsigned int>());
                     calc.OR(merge_relevance);
                 }
-                calc.AND(merge_relevance);
             }
-            if (!f.kinds.empty()) {
-                calc.push(calc.empty_set());
-                for (const auto &a: f.kinds) {
-                    docdb::Key from(a);
-                    docdb::Key to(a);
+        }});
+        p.timed = true;
+        p.covers = cover_authors | cover_kinds;
+        probe(p, f.authors.size() * f.kinds.size(), [&](std::size_t i, std::size_t limit) {
+            docdb::Key from(f.authors[i / f.kinds.size()].first, f.kinds[i % f.kinds.size()]);
+            docdb::Key to = from;
+            append_time(f, from, to);
+            return count_rows(_index_pubkey_kind_time.get_snapshot(snap).select_between(from, to), limit);
+        });
+    }
+    for(const auto &tg: f.tags) {
+        if (f.kinds.empty() || tg.second.size() * f.kinds.size() > compound_max_ranges) continue;
+        AccessPath &p = paths.emplace_back(AccessPath{"tag+kinds", 0, false, [this, &f, &tg, snap, hasher](RecordSetCalculator &calc){
+            const auto &[t, contents] = tg;
+            calc.push(calc.empty_set());
+            for (const auto &x: contents) {
+                std::size_t h = hasher(x);
+                for (const auto &k: f.kinds) {
+                    docdb::Key from(t, h, k);
+                    docdb::Key to(t, h, k);
                     append_time(f, from, to);
-                    need_time = false;
-                    calc.push(_index_kind_time.get_snapshot(snap).select_between(from, to),
-                            multi_index_ordering<unsigned int>());
+                    calc.push(_index_tag_value_kind_time.get_snapshot(snap).select_between(from, to),
+                            multi_index_ordering<unsigned char, std::size_t, unsigned int>());
                     calc.OR(merge_relevance);
                 }
-                calc.AND(merge_relevance);
             }
-            if (need_time && (f.since.has_value() || f.until.has_value())) {
-                docdb::Key from;
-                docdb::Key to;
-                append_time(f, from, to);
-                calc.push(_index_time.get_snapshot(snap).select_between(from, to),
-                        multi_index_ordering<>());
+        }});
+        p.tag = tg.first;
+        p.timed = true;
+        p.covers = cover_tag | cover_kinds;
+        p.inexact = true;
+        probe(p, tg.second.size() * f.kinds.size(), [&](std::size_t i, std::size_t limit) {
+            docdb::Key from(tg.first, hasher(tg.second[i / f.kinds.size()]), f.kinds[i % f.kinds.size()]);
+            docdb::Key to = from;
+            append_time(f, from, to);
+            return count_rows(_index_tag_value_kind_time.get_snapshot(snap).select_between(from, to), limit);
+        });
+    }
+    if (f.since.has_value() || f.until.has_value()) {
+        docdb::Key from;
+        docdb::Key to;
+        append_time(f, from, to);
+        AccessPath &p = paths.emplace_back(AccessPath{"time", 0, false, [this, from, to, snap](RecordSetCalculator &calc){
+            calc.push(_index_time.get_snapshot(snap).select_between(from, to),
+                    multi_index_ordering<>());
+        }});
+        probe(p, 1, [&](std::size_t, std::size_t limit) {
+            return count_rows(_index_time.get_snapshot(snap).select_between(from, to), limit);
+        });
+        p.timed = true;
+        p.time_index = true;
+    }
+}
+
+bool App::is_covered(const AccessPath &p, const AccessPath *driving) {
+    if (&p == driving) return true;
+    if (!driving || !p.covers || (p.covers & ~driving->covers)) return false;
+    return !(p.covers & cover_tag) || p.tag == driving->tag;
+}
+
+void App::verify_candidates(RecordSetCalculator &calc, const Filter &f) const {
+    if (calc.top().is_inverted()) return;
+    auto candidates = calc.pop();
+    auto s = calc.empty_set();
+    for (const auto &c: candidates) {
+        auto ev = find_event(c.id);
+        if (ev && f.test(*ev)) s.push_back(c);
+    }
+    calc.push(std::move(s));
+}
+
+std::string App::explain_plan(const std::vector<AccessPath> &paths, const AccessPath *driving) {
+    std::string out;
+    std::string verify;
+    auto path_name = [](const AccessPath &p) {
+        std::string n(p.name);
+        if (p.tag) n.append(" #").push_back(p.tag);
+        return n;
+    };
+    for (const auto &p: paths) {
+        bool used = p.mandatory || &p == driving;
+        if (!out.empty()) out.append(", ");
+        out.append(path_name(p));
+        if (!p.mandatory) {
+            out.append("(").append(std::to_string(p.estimate));
+            if (p.estimate >= plan_probe_limit) out.append("+");
+            out.append(")");
+        }
+        //used path is verified only when its index is inexact
+        bool verified = used?p.inexact:!is_covered(p, driving) && (!p.time_index || !driving->timed);
+        if (verified) {
+            if (!verify.empty()) verify.append(", ");
+            verify.append(path_name(p));
+        }
+    }
+    if (out.empty()) return "all documents";
+    out = "paths: " + out;
+    if (driving) out.append("; driving: ").append(path_name(*driving));
+    if (!verify.empty()) out.append("; verified by filter: ").append(verify);
+    return out;
+}
+
+void App::find_in_index(RecordSetCalculator &calc, const std::vector<Filter> &filters) const {
+    calc.clear();
+
+    docdb::PSnapshot snap = _storage.get_db()->make_snapshot();
+    std::vector<AccessPath> paths;
+
+    calc.push(calc.empty_set());
+    for (const auto &f: filters) {
+        collect_access_paths(f, snap, paths);
+        //query is driven by the most selective index, other predicates are tested by the filter
+        //estimates are capped, the path which covers more constraints wins the tie
+        const AccessPath *driving = nullptr;
+        for (const auto &p: paths) {
+            if (!p.mandatory && (!driving || p.estimate < driving->estimate
+                    || (p.estimate == driving->estimate && std::popcount(p.covers) > std::popcount(driving->covers)))) {
+                driving = &p;
+            }
+        }
+        if (_explain_queries) {
+            ondra_shared::logDebug("Query plan: $1", explain_plan(paths, driving));
+        }
+        bool verify = false;
+        calc.push(calc.all_items_set());
+        for (const auto &p: paths) {
+            if (p.mandatory || &p == driving) {
+                p.push(calc);
                 calc.AND(merge_relevance);
+                if (calc.is_top_empty()) break;
+                verify = verify || p.inexact;
+            } else if (!is_covered(p, driving) && (!p.time_index || !driving->timed)) {
+                verify = true;
             }
-        } while (false);
+        }
+        if (verify && !calc.is_top_empty()) verify_candidates(calc, f);
         calc.OR(merge_relevance);
     }
 }
 
 
 
+static void append_time_desc(std::time_t since, std::time_t until, docdb::Key &from, docdb::Key &to) {
+    //from > to - index is walked backwards (newest first)
+    //bounds are widened, rows outside of the range are skipped by the cursor
+    from.append<std::time_t>(until < std::numeric_limits<std::time_t>::max()?until+1:until);
+    to.append<std::time_t>(since > 0?since-1:0);
+}
+
+template<typename ... Args>
+static constexpr auto multi_index_time() {
+    return [](const auto &row) -> std::time_t {
+        auto tup = row.key.template get<Args..., std::time_t>();
+        return std::get<sizeof...(Args)>(tup);
+    };
+}
+
+template<typename Recordset, typename TimeFn, typename AcceptFn>
+static auto make_time_cursor(Recordset &&rs, TimeFn tmfn, AcceptFn accept, std::time_t since, std::time_t until) {
+    auto rsptr = std::make_shared<std::decay_t<Recordset> >(std::forward<Recordset>(rs));
+    return [rsptr, iter = rsptr->begin(), tmfn, accept, since, until](docdb::DocID &id, std::time_t &tm) mutable {
+        while (iter != rsptr->end()) {
+            const auto &row = *iter;
+            ++iter;
+            //rows outside of the widened bounds are skipped, so the time range is exact
+            tm = tmfn(row);
+            if (tm < since || tm > until) continue;
+            //rows rejected by the covering payload are not loaded
+            if (!accept(row)) continue;
+            id = row.id;
+            return true;
+        }
+        return false;
+    };
+}
+
+///Tests covering payload of index rows against the filter
+class CoverCheck {
+public:
+    explicit CoverCheck(const Filter &f):_kinds(f.kinds) {
+        for (const auto &[k, len]: f.authors) {
+            std::uint64_t mask = 0;
+            auto mask_bytes = reinterpret_cast<unsigned char *>(&mask);
+            for (std::size_t i = 0; i < sizeof(mask) && i < len; ++i) mask_bytes[i] = 0xFF;
+            _authors.push_back({author_prefix(k) & mask, mask});
+        }
+    }
+    bool kind(unsigned int k) const {
+        return _kinds.empty() || std::find(_kinds.begin(), _kinds.end(), k) != _kinds.end();
+    }
+    bool author(std::uint64_t prefix) const {
+        return _authors.empty() || std::any_of(_authors.begin(), _authors.end(), [&](const auto &a){
+            return (prefix & a.second) == a.first;
+        });
+    }
+protected:
+    std::vector<Event::Kind> _kinds;
+    ///prefix and mask
+    std::vector<std::pair<std::uint64_t, std::uint64_t> > _authors;
+};
+
+static PQueryCursor make_or_cursor(std::vector<PQueryCursor> &&cursors) {
+    if (cursors.size() == 1) return std::move(cursors.front());
+    return std::make_unique<OrCursor>(std::move(cursors));
+}
+
+PQueryCursor App::create_cursor(const Filter &f, const docdb::PSnapshot &snap) const {
+    std::hash<std::string_view> hasher;
+    std::time_t until = f.until.has_value()?*f.until:std::numeric_limits<std::time_t>::max();
+    std::time_t since = f.since.has_value()?*f.since:0;
+    auto check = std::make_shared<const CoverCheck>(f);
+    auto accept_all = [](const auto &) {return true;};
+    //cursor over the range of the index, which is reopened when cursor seeks far
+    auto open = [&](const auto &index, docdb::Key prefix, auto tmfn, auto accept) -> PQueryCursor {
+        return std::make_unique<IndexCursor>([idx = &index, prefix, since, flt_until = until, tmfn, accept, snap](std::time_t until) -> IndexCursor::Range {
+            docdb::Key from = prefix;
+            docdb::Key to = prefix;
+            append_time_desc(since, until, from, to);
+            return make_time_cursor(idx->get_snapshot(snap).select_between(from, to), tmfn, accept, since, flt_until);
+        }, until);
+    };
+    //covering payloads, see IndexByPubkeyHashTimeFn
+    auto accept_pubkey = [check](const auto &row) {
+        auto [k] = row.value.template get<unsigned int>();
+        return check->kind(k);
+    };
+    auto accept_kind = [check](const auto &row) {
+        auto [a] = row.value.template get<std::uint64_t>();
+        return check->author(a);
+    };
+    auto accept_tag = [check](std::uint32_t vchk) {
+        return [check, vchk](const auto &row) {
+            auto [k, a, v] = row.value.template get<unsigned int, std::uint64_t, std::uint32_t>();
+            return v == vchk && check->kind(k) && check->author(a);
+        };
+    };
+    auto accept_tag_kind = [check](std::uint32_t vchk) {
+        return [check, vchk](const auto &row) {
+            auto [a, v] = row.value.template get<std::uint64_t, std::uint32_t>();
+            return v == vchk && check->author(a);
+        };
+    };
+    //every constraint is a union of ranges, constraints are joined by AND
+    std::vector<PQueryCursor> constraints;
+    bool full_authors = !f.authors.empty() && std::all_of(f.authors.begin(), f.authors.end(), [](const auto &a){
+        return a.second == a.first.size();
+    });
+    //kinds are joined into compound index if possible
+    bool kinds_done = f.kinds.empty();
+    if (full_authors) {
+        std::vector<PQueryCursor> c;
+        if (!kinds_done && f.authors.size() * f.kinds.size() <= compound_max_ranges) {
+            for (const auto &a: f.authors) {
+                for (const auto &k: f.kinds) {
+                    c.push_back(open(_index_pubkey_kind_time, docdb::Key(a.first, k), multi_index_time<Event::Pubkey, unsigned int>(), accept_all));
+                }
+            }
+            kinds_done = true;
+        } else {
+            for (const auto &a: f.authors) {
+                c.push_back(open(_index_pubkey_time, docdb::Key(a.first), multi_index_time<Event::Pubkey>(), accept_pubkey));
+            }
+        }
+        constraints.push_back(make_or_cursor(std::move(c)));
+    }
+    for (const auto &[t, contents]: f.tags) {
+        std::vector<PQueryCursor> c;
+        if (!kinds_done && contents.size() * f.kinds.size() <= compound_max_ranges) {
+            for (const auto &x: contents) {
+                for (const auto &k: f.kinds) {
+                    c.push_back(open(_index_tag_value_kind_time, docdb::Key(t, hasher(x), k), multi_index_time<unsigned char, std::size_t, unsigned int>(), accept_tag_kind(tag_value_check(x))));
+                }
+            }
+            kinds_done = true;
+        } else {
+            for (const auto &x: contents) {
+                c.push_back(open(_index_tag_value_time, docdb::Key(t, hasher(x)), multi_index_time<unsigned char, std::size_t>(), accept_tag(tag_value_check(x))));
+            }
+        }
+        constraints.push_back(make_or_cursor(std::move(c)));
+    }
+    if (!kinds_done) {
+        std::vector<PQueryCursor> c;
+        for (const auto &k: f.kinds) {
+            c.push_back(open(_index_kind_time, docdb::Key(k), multi_index_time<unsigned int>(), accept_kind));
+        }
+        constraints.push_back(make_or_cursor(std::move(c)));
+    }
+    if (constraints.empty()) {
+        constraints.push_back(open(_index_time, docdb::Key(), multi_index_time<>(), accept_all));
+    }
+    if (constraints.size() == 1) return std::move(constraints.front());
+    return std::make_unique<AndCursor>(std::move(constraints));
+}
+
+bool App::can_scan_newest(const std::vector<Filter> &filters, std::size_t limit) {
+    if (std::any_of(filters.begin(), filters.end(), [](const Filter &f){
+        return !f.ft_search.empty() || !f.ids.empty();
+    })) return false;
+    //without limit, whole database is not returned (same as find_in_index)
+    return limit != static_cast<std::size_t>(-1) || std::none_of(filters.begin(), filters.end(), [](const Filter &f){
+        return f.authors.empty() && f.tags.empty() && f.kinds.empty() && !f.since.has_value() && !f.until.has_value();
+    });
+}
+
+bool App::find_newest(const std::vector<Filter> &filters, std::size_t limit, DocIDList &result) const {
+    if (!can_scan_newest(filters, limit)) return false;
+    if (_recent.find(filters, limit, result)) return true;
+    ResultCache::Query q(filters, limit);
+    if (_result_cache.find(q, result)) return true;
+    //the query must be registered before the snapshot is made
+    auto ticket = _result_cache.watch(q, filters);
+    ResultCache::Result items;
+    scan_newest(filters, limit, items);
+    result.clear();
+    result.reserve(items.size());
+    for (const auto &itm: items) result.push_back(itm.id);
+    _result_cache.put(std::move(ticket), q, items);
+    return true;
+}
+
+void App::scan_newest(const std::vector<Filter> &filters, std::size_t limit, ResultCache::Result &result) const {
+    docdb::PSnapshot snap = _storage.get_db()->make_snapshot();
+    std::vector<PQueryCursor> cursors;
+    for (const auto &f: filters) cursors.push_back(create_cursor(f, snap));
+    //nothing is materialized, documents are read as the cursor moves
+    OrCursor cursor(std::move(cursors));
+
+    std::optional<CursorItem> last;
+    std::size_t loaded = 0;
+    result.clear();
+    for (; !cursor.at_end() && result.size() < limit; cursor.next()) {
+        const CursorItem &h = cursor.current();
+        //duplicated items are always adjacent
+        if (last == h) continue;
+        last = h;
+        //candidate is tested without decoding
+        ++loaded;
+        auto doc = find_event(h.id);
+        if (!doc || !doc->is_event()) continue;
+        const EventView &ev = *doc;
+        //all filters are tested, the result cache needs to know which filters matched
+        std::uint32_t mask = 0;
+        bool match = false;
+        for (std::size_t i = 0; i < filters.size(); ++i) {
+            if (filters[i].test(ev)) {
+                match = true;
+                //such query is not cached, the mask is not needed
+                if (i >= ResultCache::max_filters) break;
+                mask |= 1U << i;
+            }
+        }
+        if (match) result.push_back({h.time, h.id, mask});
+    }
+    if (_explain_queries) {
+        ondra_shared::logDebug("Query scan: loaded $1 document(s), returned $2 event(s)", loaded, result.size());
+    }
+}
+
+bool App::is_cursor_exact(const Filter &f) {
+    //tags are indexed by hash and authors by prefix, kinds and time are exact
+    return f.tags.empty() && f.ids.empty() && f.ft_search.empty()
+            && std::all_of(f.authors.begin(), f.authors.end(), [](const auto &a){
+        return a.second == a.first.size();
+    });
+}
+
+std::optional<std::size_t> App::count_newest(const std::vector<Filter> &filters) const {
+    if (!can_scan_newest(filters, static_cast<std::size_t>(-1))) return std::nullopt;
+    if (!std::all_of(filters.begin(), filters.end(), &is_cursor_exact)) return std::nullopt;
+    docdb::PSnapshot snap = _storage.get_db()->make_snapshot();
+    std::vector<PQueryCursor> cursors;
+    for (const auto &f: filters) cursors.push_back(create_cursor(f, snap));
+    OrCursor cursor(std::move(cursors));
+    std::optional<CursorItem> last;
+    std::size_t cnt = 0;
+    for (; !cursor.at_end(); cursor.next()) {
+        const CursorItem &h = cursor.current();
+        //duplicated items are always adjacent
+        if (last == h) continue;
+        last = h;
+        ++cnt;
+    }
+    return cnt;
+}
+
+EventCache::PEvent App::find_event(docdb::DocID id) const {
+    auto ev = _event_cache.find(id);
+    if (ev) return ev;
+    auto doc = _view_storage.find(id);
+    if (!doc) return nullptr;
+    ev = std::make_shared<const EventView>(std::move(doc->document));
+    _event_cache.put(id, ev);
+    return ev;
+}
+
+bool App::find_ranked(const Filter &filter, RankedList &result) const {
+    RecordSetCalculator calc;
+    find_in_index(calc, {filter});
+    auto candidates = calc.pop();
+    if (candidates.is_inverted()) return false;
+    result.clear();
+    result.reserve(candidates.size());
+    for (const auto &cd: candidates) result.push_back({cd.value, cd.id});
+    return true;
+}
+
+cocls::future<std::optional<App::RankedList> > App::find_ranked_parallel(const std::vector<Filter> &filters) {
+    //every filter is executed as an independent query
+    using PartResult = std::optional<RankedList>;
+    std::vector<std::unique_ptr<cocls::future<PartResult> > > parts;
+    parts.reserve(filters.size());
+    for (const Filter &f: filters) {
+        parts.emplace_back(new auto(_query_executor.run([this, &f]{
+            PartResult r(std::in_place);
+            if (!find_ranked(f, *r)) r.reset();
+            return r;
+        })));
+    }
+    //all parts must be awaited, they refer to the filters
+    std::exception_ptr exp;
+    bool inverted = false;
+    RankedList result;
+    for (auto &p: parts) {
+        try {
+            PartResult r = co_await *p;
+            if (!r.has_value()) inverted = true;
+            else if (!inverted) result.insert(result.end(), r->begin(), r->end());
+        } catch (...) {
+            exp = std::current_exception();
+        }
+    }
+    if (exp) std::rethrow_exception(exp);
+    if (inverted) co_return std::nullopt;
+    //remove duplicates, keep the best ordering
+    std::sort(result.begin(), result.end(), [](const auto &a, const auto &b){
+        return a.second == b.second?a.first > b.first:a.second < b.second;
+    });
+    result.erase(std::unique(result.begin(), result.end(), [](const auto &a, const auto &b){
+        return a.second == b.second;
+    }), result.end());
+    co_return result;
+}
+
+cocls::future<IApp::DocIDList> App::query(std::vector<Filter> filters, std::size_t limit) {
+    DocIDList found;
+    bool done = co_await _query_executor.run([&]{
+        return find_newest(filters, limit, found);
+    });
+    if (done) co_return found;
+    std::optional<RankedList> ranked = co_await find_ranked_parallel(filters);
+    if (ranked.has_value()) {
+        std::sort(ranked->begin(), ranked->end(), [](const auto &a, const auto &b){
+            return a.first > b.first;
+        });
+        found.reserve(ranked->size());
+        for (const auto &r: *ranked) found.push_back(r.second);
+    }
+    co_return found;
+}
+
+std::optional<std::size_t> App::count_from_index(const std::vector<Filter> &filters) const {
+    //filters are joined by OR, an event matching multiple filters would be counted twice
+    if (filters.size() != 1) return std::nullopt;
+    const Filter &f = filters.front();
+    if (f.kinds.empty() || !f.ids.empty() || !f.authors.empty() || f.since.has_value()
+            || f.until.has_value() || !f.ft_search.empty() || f.tags.size() != 1) return std::nullopt;
+    const auto &[tag, values] = f.tags.front();
+    if (values.size() != 1 || CountIndexFn::counted_tags.find(tag) == CountIndexFn::counted_tags.npos) return std::nullopt;
+    auto kinds = f.kinds;
+    std::sort(kinds.begin(), kinds.end());
+    kinds.erase(std::unique(kinds.begin(), kinds.end()), kinds.end());
+    //event has only one kind, so counters can be summed
+    std::size_t cnt = 0;
+    for (auto k: kinds) {
+        auto r = _index_counts.find(docdb::Key(k, tag, std::string_view(values.front())));
+        if (r) cnt += *r;
+    }
+    return cnt;
+}
+
+std::optional<std::size_t> App::estimate_count(const std::vector<Filter> &filters) const {
+    if (!_index_time_counts.has_value() || filters.size() != 1) return std::nullopt;
+    const Filter &f = filters.front();
+    if (!f.ids.empty() || !f.authors.empty() || !f.ft_search.empty()) return std::nullopt;
+    //only one dimension is counted
+    if (!f.kinds.empty() && !f.tags.empty()) return std::nullopt;
+    if (f.tags.size() > 1 || (f.tags.size() == 1 && f.tags.front().second.size() != 1)) return std::nullopt;
+    if (f.tags.size() == 1 && CountIndexFn::counted_tags.find(f.tags.front().first) == CountIndexFn::counted_tags.npos) {
+        return std::nullopt;
+    }
+
+    using Fn = TimeBucketCountFn;
+    std::vector<Event::Kind> kinds = f.kinds;
+    std::sort(kinds.begin(), kinds.end());
+    kinds.erase(std::unique(kinds.begin(), kinds.end()), kinds.end());
+
+    auto read_bucket = [&](unsigned char l, std::time_t bucket) -> std::size_t {
+        auto read = [&](const docdb::Key &k) -> std::size_t {
+            auto r = _index_time_counts->find(k);
+            return r?*r:0;
+        };
+        if (!f.tags.empty()) {
+            const auto &[tag, values] = f.tags.front();
+            return read(docdb::Key('t', l, tag, std::string_view(values.front()), bucket));
+        }
+        if (kinds.empty()) return read(docdb::Key('a', l, bucket));
+        std::size_t sum = 0;
+        for (auto k: kinds) sum += read(docdb::Key('k', l, k, bucket));
+        return sum;
+    };
+
+    //range [from, to)
+    std::time_t from = f.since.has_value()?std::max<std::time_t>(*f.since, 0):0;
+    std::time_t to = f.until.has_value()?*f.until+1:std::time(nullptr)+Fn::levels[0];
+    if (from >= to) return 0;
+    double estimate = 0;
+    double uncertain = 0;
+    //partially covered buckets on the edges are interpolated
+    auto partial = [&](std::time_t bucket_start, std::time_t b, std::time_t e) {
+        double cnt = static_cast<double>(read_bucket(0, bucket_start / Fn::levels[0]));
+        estimate += cnt * static_cast<double>(e - b) / static_cast<double>(Fn::levels[0]);
+        uncertain += cnt;
+    };
+    if (from % Fn::levels[0]) {
+        std::time_t bs = from - from % Fn::levels[0];
+        std::time_t be = std::min(bs + Fn::levels[0], to);
+        partial(bs, from, be);
+        from = be;
+    }
+    if (from < to && to % Fn::levels[0]) {
+        std::time_t bs = to - to % Fn::levels[0];
+        partial(bs, bs, to);
+        to = bs;
+    }
+    //the aligned middle part is summed from the largest buckets which fit
+    double exact = 0;
+    while (from < to) {
+        unsigned char l = Fn::level_count;
+        do --l; while (l && (from % Fn::levels[l] || from + Fn::levels[l] > to));
+        exact += static_cast<double>(read_bucket(l, from / Fn::levels[l]));
+        from += Fn::levels[l];
+    }
+    //fully covered buckets are lower bound of the count, small count is counted exactly
+    if (exact < static_cast<double>(estimate_min_count)) return std::nullopt;
+    estimate += exact;
+    if (uncertain > estimate * _count_max_error) return std::nullopt;
+    return static_cast<std::size_t>(estimate + 0.5);
+}
+
+cocls::future<IApp::CountResult> App::count(std::vector<Filter> filters) {
+    //counters are read from the database too, nothing is executed in the IO thread
+    std::optional<CountResult> res = co_await _query_executor.run([&]() -> std::optional<CountResult> {
+        if (auto c = count_from_index(filters)) return CountResult{*c, false};
+        if (auto c = estimate_count(filters)) return CountResult{*c, true};
+        //documents are not loaded, other filters are counted by the index path
+        if (auto c = count_newest(filters)) return CountResult{*c, false};
+        return std::nullopt;
+    });
+    if (res.has_value()) co_return *res;
+    std::optional<RankedList> ranked = co_await find_ranked_parallel(filters);
+    co_return CountResult{ranked.has_value()?ranked->size():0, false};
+}
+
+
 cocls::future<bool> App::send_infodoc(coroserver::http::ServerRequest &req) {
     JSON doc = App::get_server_capabilities();
     req.add_header(coroserver::http::strtable::hdr_content_type, "application/nostr+json");
@@ -550,7 +1323,7 @@ cocls::future<bool> App::send_simple_stats(coroserver::http::ServerRequest &req)
 }
 
 bool App::is_home_user(const Event::Pubkey &pubkey) const {
-    auto r = _index_whitelist.find(pubkey);
+    auto r = _karma.find(pubkey);
     if (!r) return false;
     return r->local;
 }
@@ -565,9 +1338,11 @@ void App::publish(Event &&event, const void *publisher)  {
     //to_replace==-1 means that this event is old, cannot be replaced
     if (to_replace != docdb::DocID(-1)) {
         //replace event
+        StorageCommit sc(*this);
         _storage.put(event, to_replace);
+        sc.committed();
         //publish event
-        event_publish.publish(EventSource{std::move(event),publisher});
+        broadcast(std::move(event), publisher);
 
         if (gc) {
             start_gc_thread();
@@ -586,15 +1361,162 @@ void App::publish(Event &&ev, const Attachment &attach, const void *publisher) {
     if (to_replace != docdb::DocID(-1)) {
         //replace event
         docdb::Batch b;
+        StorageCommit sc(*this);
         _storage.put(b, ev, to_replace);
         _storage.put(b, std::move(attach), att_to_replace);
-        _db->commit_batch(b);
+        sc.commit(b);
         //publish event
-        event_publish.publish(EventSource{std::move(ev),publisher});
+        broadcast(std::move(ev), publisher);
+    }
+
+
+
+}
+
+EventWriter::Callbacks App::writer_callbacks() {
+    return {
+        [this](docdb::Batch &b, const Event &ev) {
+            //to_replace==-1 means that this event is old, cannot be replaced
+            auto to_replace = doc_to_replace(ev);
+            if (to_replace == docdb::DocID(-1)) return false;
+            EventDocument::OptionsScope opts(EventDocument::Options{_store_json});
+            _storage.put(b, ev, to_replace);
+            return true;
+        },
+        [this](docdb::Batch &b) {
+            _db->commit_batch(b);
+            apply_storage_changes();
+        },
+        [] {
+            //changes of discarded batch were not made
+            discard_storage_changes();
+        },
+        [this](Event &&ev, const void *publisher) {
+            bool gc = ev.kind == kind::Event_Deletion;
+            broadcast(std::move(ev), publisher);
+            if (gc) start_gc_thread();
+        }
+    };
+}
+
+cocls::future<void> App::write_event(Event &&ev, const void *publisher) {
+    return _writer.write(std::move(ev), publisher);
+}
+
+void App::StorageCommit::commit(docdb::Batch &b) {
+    _app._db->commit_batch(b);
+    _app.apply_storage_changes();
+}
+
+void App::discard_storage_changes() {
+    storage_changes.clear();
+    id_changes.clear();
+    karma_changes.clear();
+}
+
+void App::apply_storage_changes() {
+    //removed ids are removed after commit, otherwise the filter could deny stored event
+    for (const auto &[id, removed]: id_changes) {
+        if (removed) _id_filter.remove(id);
+        else _id_filter.add(id);
+    }
+    id_changes.clear();
+    if (_id_filter.is_overflow()) start_id_filter_rebuild();
+    //karma is reloaded from the index, the aggregator already updated it
+    std::sort(karma_changes.begin(), karma_changes.end());
+    karma_changes.erase(std::unique(karma_changes.begin(), karma_changes.end()), karma_changes.end());
+    for (const auto &pk: karma_changes) {
+        _karma.reload(pk, [&]{return read_karma(pk);});
+    }
+    karma_changes.clear();
+    for (StorageChange &ch: storage_changes) {
+        if (ch.removed) {
+            _recent.remove(ch.id, ch.ev);
+            _result_cache.invalidate(EventSource{std::move(ch.ev), nullptr});
+        } else {
+            _recent.add(ch.id, std::make_shared<const Event>(std::move(ch.ev)));
+        }
     }
+    storage_changes.clear();
+}
 
+std::size_t App::load_recent_events(const std::vector<Event::Kind> &kinds) {
+    std::size_t cnt = 0;
+    for (auto k: kinds) {
+        if (!_recent.is_hot(k)) continue;
+        Filter f;
+        f.kinds.push_back(k);
+        std::time_t min_time = _recent.get_min_time();
+        if (min_time) f.since = min_time;
+        ResultCache::Result items;
+        scan_newest({f}, _recent.get_max_count(), items);
+        //oldest first, so events are appended
+        for (auto iter = items.rbegin(); iter != items.rend(); ++iter) {
+            auto doc = _storage.find(iter->id);
+            if (!doc) continue;
+            Event *ev = std::get_if<Event>(&doc->document);
+            if (ev) _recent.add(iter->id, std::make_shared<const Event>(std::move(*ev)));
+        }
+        cnt += items.size();
+        //when the limit was reached, older events are not in the memory
+        _recent.set_horizon(k, items.size() < _recent.get_max_count()?min_time:items.back().time+1);
+    }
+    return cnt;
+}
 
+std::size_t App::load_id_filter(std::stop_token stp) {
+    //last document id is upper bound of count of stored events, leave space for growth
+    _id_filter.reset(std::max<std::size_t>({_storage.get_rev() * 2, _id_filter.get_capacity() * 2, 1024*1024}));
+    //ids committed during the load are added by the observer, removed ids are skipped
+    std::size_t cnt = 0;
+    for (const auto &row: _index_by_id.select_all()) {
+        if (stp.stop_requested()) return cnt;
+        auto [id] = row.key.get<Event::ID>();
+        _id_filter.load(id);
+        ++cnt;
+    }
+    _id_filter.set_ready();
+    return cnt;
+}
 
+void App::start_id_filter_rebuild() {
+    if (_id_filter_rebuilding.exchange(true, std::memory_order_relaxed) == false) {
+        if (_id_filter_thread.joinable()) _id_filter_thread.join();
+        _id_filter_thread = std::jthread([&](std::stop_token stp){
+            ondra_shared::LogObject lg("IdFilter");
+            try {
+                auto s = load_id_filter(stp);
+                lg.progress("Rebuilt with capacity $1, $2 id(s)", _id_filter.get_capacity(), s);
+            } catch(std::exception &e) {
+                lg.error("$1", e.what());
+            } catch(...) {
+                lg.error("unknown exception");
+            }
+            _id_filter_rebuilding.store(false, std::memory_order_relaxed);
+        });
+    }
+}
+
+void App::erase_event(docdb::DocID id) {
+    StorageCommit sc(*this);
+    _storage.erase(id);
+    sc.committed();
+}
+
+void App::commit(const std::function<void(docdb::Batch &)> &build) {
+    docdb::Batch b;
+    StorageCommit sc(*this);
+    build(b);
+    sc.commit(b);
+}
+
+void App::broadcast(Event &&ev, const void *publisher) {
+    EventSource src{std::move(ev), publisher};
+    //the event is already committed, cached results missing the new event
+    //are dropped (removals were applied by the commit)
+    _result_cache.invalidate(src);
+    _subscriptions.publish(src);
+    event_publish.publish(std::move(src));
 }
 
 
@@ -648,13 +1570,40 @@ std::size_t App::run_attachment_gc(ondra_shared::LogObject &lg, std::stop_token
         lg.debug("Deleting attachment: $1", k.to_hex());
         auto fnd = _index_attachments.find(k);
         if (fnd) {
-            _storage.erase(fnd->id);
+            erase_event(fnd->id);
         }
     }
     return killthem.size();
 }
 
+std::size_t App::migrate_json(ondra_shared::LogObject &lg) {
+    constexpr std::size_t batch_size = 1000;
+    std::size_t count = 0;
+    //rewritten events receive new ids, they are not visited again
+    docdb::DocID last = _storage.get_rev();
+    auto b = std::make_unique<docdb::Batch>();
+    StorageCommit sc(*this);
+    for (docdb::DocID id = 1; id <= last; ++id) {
+        auto doc = _view_storage.find(id);
+        if (!doc) continue;
+        const EventView &view = doc->document;
+        if (!view.is_event() || !view.json().empty()) continue;
+        //only current version of the event is rewritten
+        if (find_event_by_id(view.id) != id) continue;
+        Event ev = view.decode().to_event();
+        _storage.put(*b, ev, id);
+        if (++count % batch_size == 0) {
+            sc.commit(*b);
+            b = std::make_unique<docdb::Batch>();
+            lg.progress("Migrated $1 event(s)", count);
+        }
+    }
+    sc.commit(*b);
+    return count;
+}
+
 docdb::DocID App::find_event_by_id(const Event::ID &id) const {
+    if (!_id_filter.may_contain(id)) return 0;
     auto r = _index_by_id.find(id);
     if (r) return r->id;
     else return 0;
@@ -8,7 +8,11 @@
 #include "telemetry_def.h"
 #include "../telemetry/open_metrics/Collector.h"
 #include "whitelist.h"
+#include "count_index.h"
 #include "routing.h"
+#include "query_executor.h"
+#include "query_cursor.h"
+#include "karma_table.h"
 
 
 #include <docdb/json.h>
@@ -18,6 +22,7 @@
 #include <coroserver/http_static_page.h>
 #include <shared/logOutput.h>
 #include <stop_token>
+#include <functional>
 #include <memory>
 #include <set>
 #include <thread>
@@ -39,16 +44,28 @@ public:
 
 
     virtual EventPublisher &get_publisher() override {return event_publish;}
+    virtual SubscriptionIndex &get_subscriptions() override {return _subscriptions;}
     virtual Storage &get_storage() override {return _storage;}
+    virtual const FlatStorage &get_flat_storage() const override {return _flat_storage;}
+    virtual const EventViewStorage &get_view_storage() const override {return _view_storage;}
+    virtual EventCache::PEvent find_event(docdb::DocID id) const override;
+    virtual SignatureVerifier &get_verifier() override {return _verifier;}
     virtual docdb::DocID doc_to_replace(const Event &event) const override;
     virtual docdb::DocID find_event_by_id(const Event::ID &id) const override;
     virtual void find_in_index(RecordSetCalculator &calc, const std::vector<Filter> &filters) const override ;
+    virtual bool find_newest(const std::vector<Filter> &filters, std::size_t limit, DocIDList &result) const override;
+    virtual cocls::future<DocIDList> query(std::vector<Filter> filters, std::size_t limit) override;
+    virtual cocls::future<CountResult> count(std::vector<Filter> filters) override;
     virtual docdb::PDatabase get_database() const override {return _db;}
     virtual JSON get_server_capabilities() const override;
     virtual bool is_home_user(const Event::Pubkey &pubkey) const override;
     virtual void client_counter(int increment, std::string_view url) override;
     virtual void publish(Event &&ev, const void *publisher) override;
     virtual void publish(Event &&ev, const Attachment &attach, const void *publisher) override;
+    virtual void broadcast(Event &&ev, const void *publisher) override;
+    virtual void erase_event(docdb::DocID id) override;
+    virtual void commit(const std::function<void(docdb::Batch &)> &build) override;
+    virtual cocls::future<void> write_event(Event &&ev, const void *publisher) override;
     virtual docdb::DocID find_replacable(std::string_view pubkey, unsigned int kind, std::string_view category) const override;
     virtual bool check_whitelist(const Event::Pubkey &k) const override;
     virtual docdb::DocID find_attachment(const Attachment::ID &id) const override;
@@ -64,18 +81,38 @@ protected:
         static constexpr int revision = 3;
         template<typename Emit> void operator ()(Emit emit, const EventOrAttachment &ev) const;
     };
+    ///Multi indexes used to search events carry covering payload in the value
+    /**
+     * The payload allows to reject a row during the index scan without
+     * loading the document
+     *
+     * pubkey_hash_time - {kind}
+     * tag_value_time - {kind, author prefix, value check}
+     * kind_time - {author prefix}
+     * tag_value_kind_time - {author prefix, value check}
+     *
+     * see author_prefix() and tag_value_check()
+     */
     struct IndexByPubkeyHashTimeFn {
-        static constexpr int revision = 1;
+        static constexpr int revision = 2;
         template<typename Emit> void operator ()(Emit emit, const EventOrAttachment &ev) const;
     };
     struct IndexTagValueHashTimeFn {
-        static constexpr int revision = 2;
+        static constexpr int revision = 3;
         template<typename Emit> void operator ()(Emit emit, const EventOrAttachment &ev) const;
     };
     struct IndexKindTimeFn {
+        static constexpr int revision = 2;
+        template<typename Emit> void operator ()(Emit emit, const EventOrAttachment &ev) const;
+    };
+    struct IndexPubkeyKindTimeFn {
         static constexpr int revision = 1;
         template<typename Emit> void operator ()(Emit emit, const EventOrAttachment &ev) const;
     };
+    struct IndexTagValueKindTimeFn {
+        static constexpr int revision = 2;
+        template<typename Emit> void operator ()(Emit emit, const EventOrAttachment &ev) const;
+    };
     struct IndexTimeFn {
         static constexpr int revision = 1;
         template<typename Emit> void operator ()(Emit emit, const EventOrAttachment &ev) const;
@@ -104,12 +141,15 @@ protected:
     using IndexByPubkeyTime = docdb::Indexer<Storage,IndexByPubkeyHashTimeFn,docdb::IndexType::multi>;
     using IndexTagValueHashTime = docdb::Indexer<Storage,IndexTagValueHashTimeFn,docdb::IndexType::multi>;
     using IndexKindTime = docdb::Indexer<Storage,IndexKindTimeFn,docdb::IndexType::multi>;
+    using IndexPubkeyKindTime = docdb::Indexer<Storage,IndexPubkeyKindTimeFn,docdb::IndexType::multi>;
+    using IndexTagValueKindTime = docdb::Indexer<Storage,IndexTagValueKindTimeFn,docdb::IndexType::multi>;
     using IndexTime = docdb::Indexer<Storage,IndexTimeFn,docdb::IndexType::multi>;
     using IndexForFulltext = docdb::Indexer<Storage,IndexForFulltextFn,docdb::IndexType::multi>;
     using IndexAttachments = docdb::Indexer<Storage,IndexAttachmentFn,docdb::IndexType::unique>;
     using IndexNip05 = docdb::Indexer<Storage,IndexNip05Fn,docdb::IndexType::unique>;
 
     EventPublisher event_publish;
+    SubscriptionIndex _subscriptions;
     docdb::PDatabase _db;
     ServerDescription _server_desc;
     ServerOptions _server_options;
@@ -118,34 +158,164 @@ protected:
     std::shared_ptr<telemetry::open_metrics::Collector> _omcoll;
     telemetry::SharedSensor<docdb::PDatabase> _dbsensor;
     telemetry::SharedSensor<StorageSensor> _storage_sensor;
-    mutable bool _empty_database = true;
+    telemetry::SharedSensor<QueryExecutorSensor> _query_sensor;
+    telemetry::SharedSensor<EventCacheSensor> _cache_sensor;
+    telemetry::SharedSensor<ResultCacheSensor> _result_cache_sensor;
+    telemetry::SharedSensor<RecentEventsSensor> _recent_sensor;
+    telemetry::SharedSensor<EventWriterSensor> _writer_sensor;
+    telemetry::SharedSensor<IdFilterSensor> _id_filter_sensor;
 
 
     Storage _storage;
+    FlatStorage _flat_storage;
+    EventViewStorage _view_storage;
+    mutable EventCache _event_cache;
+    mutable ResultCache _result_cache;
+    RecentEvents _recent;
+    IdFilter _id_filter;
+    KarmaTable _karma;
     IndexById _index_by_id;
     IndexByPubkeyTime _index_pubkey_time;
     IndexByAuthorKind _index_replaceable;
     IndexTagValueHashTime _index_tag_value_time;
     IndexKindTime _index_kind_time;
+    IndexPubkeyKindTime _index_pubkey_kind_time;
+    IndexTagValueKindTime _index_tag_value_kind_time;
     IndexTime _index_time;
     IndexForFulltext _index_fulltext;
     WhiteListIndex _index_whitelist;
     IndexAttachments _index_attachments;
     RoutingIndex _index_routing;
     IndexNip05 _index_nip05;
+    CountIndex _index_counts;
+    ///maintained only when approximate count is enabled
+    std::optional<TimeBucketCountIndex> _index_time_counts;
 
 
     Storage::TransactionObserver autocompact();
 
+    ///Index used to search candidates of the filter (see find_in_index)
+    struct AccessPath {
+        std::string_view name;
+        ///estimated count of candidates, limited by plan_probe_limit
+        std::size_t estimate;
+        ///path is always used, because the predicate is not tested by the filter
+        bool mandatory;
+        ///pushes candidates to the calculator as a single set
+        std::function<void(RecordSetCalculator &)> push;
+        ///tag name for tag paths
+        char tag = 0;
+        ///candidates are already limited by since and until
+        bool timed = false;
+        ///path uses the time index
+        bool time_index = false;
+        ///constraints of the filter satisfied by the path (cover_xxx)
+        unsigned int covers = 0;
+        ///candidates can contain false positives (index keyed by hash of the value),
+        ///they must be verified by the filter
+        bool inexact = false;
+    };
+    static constexpr unsigned int cover_authors = 1;
+    static constexpr unsigned int cover_kinds = 2;
+    static constexpr unsigned int cover_tag = 4;
+    ///returns true, if the constraint of the path is satisfied by the driving path
+    static bool is_covered(const AccessPath &p, const AccessPath *driving);
+    ///maximum count of rows read from an index to estimate size of the path
+    static constexpr std::size_t plan_probe_limit = 128;
+    ///maximum count of ranges probed for a path, size of other ranges is extrapolated
+    static constexpr std::size_t plan_probe_ranges = 8;
+    ///minimal count of events fully covered by the time buckets to use the estimate
+    /** Smaller counts are counted exactly, it is cheap */
+    static constexpr std::size_t estimate_min_count = 1000;
+    ///maximum count of ranges of compound index (combinations of values)
+    static constexpr std::size_t compound_max_ranges = 256;
+    bool _explain_queries = false;
+    ///maximum relative error of approximate COUNT, 0 - disabled
+    double _count_max_error = 0;
+    ///store canonical JSON with new events
+    bool _store_json = false;
+
+    void collect_access_paths(const Filter &f, const docdb::PSnapshot &snap, std::vector<AccessPath> &paths) const;
+    ///removes candidates on the top of the calculator, which are not matching the filter
+    void verify_candidates(RecordSetCalculator &calc, const Filter &f) const;
+    static std::string explain_plan(const std::vector<AccessPath> &paths, const AccessPath *driving);
+
+    ///Creates lazy cursor over candidates of the filter (newest first)
+    PQueryCursor create_cursor(const Filter &f, const docdb::PSnapshot &snap) const;
+    ///returns true, if the filters can be processed by scan_newest
+    static bool can_scan_newest(const std::vector<Filter> &filters, std::size_t limit);
+    ///Reads newest matching events, reports which filters matched each event
+    void scan_newest(const std::vector<Filter> &filters, std::size_t limit, ResultCache::Result &result) const;
+    ///Counting mode of scan_newest, counts rows of the cursors without reading the documents
+    /**
+     * @return count, or no value, if the cursors don't imply the filters (the
+     * documents would have to be tested)
+     */
+    std::optional<std::size_t> count_newest(const std::vector<Filter> &filters) const;
+    ///returns true, if the cursor of the filter returns only matching events
+    static bool is_cursor_exact(const Filter &f);
+    ///updates recent events, the id filter, the karma and the result cache after the storage was changed
+    void apply_storage_changes();
+    ///discards changes of the storage collected by failed write
+    static void discard_storage_changes();
+
+    ///Scope of a write to the storage
+    /**
+     * Changes of the storage are collected by the current thread during the
+     * write. They are applied by commit() or committed(). When the scope
+     * is left without commit (the write failed), they are discarded
+     */
+    class StorageCommit {
+    public:
+        explicit StorageCommit(App &app):_app(app),_opts(EventDocument::Options{app._store_json}) {}
+        StorageCommit(const StorageCommit &) = delete;
+        StorageCommit &operator=(const StorageCommit &) = delete;
+        ~StorageCommit() {discard_storage_changes();}
+        ///commit the batch and apply changes
+        void commit(docdb::Batch &b);
+        ///apply changes of direct write (put or erase without batch)
+        void committed() {_app.apply_storage_changes();}
+    protected:
+        App &_app;
+        EventDocument::OptionsScope _opts;
+    };
+    ///loads recent events of the kinds during start, returns count of events
+    std::size_t load_recent_events(const std::vector<Event::Kind> &kinds);
+    ///fills the id filter from the index, returns count of ids
+    /** Capacity is at least twice of the current capacity, so the filter
+     * grows, when it is rebuilt after overflow */
+    std::size_t load_id_filter(std::stop_token stp = {});
+    ///rebuilds the id filter in background
+    void start_id_filter_rebuild();
+    ///fills the karma table from the index during start, returns count of pubkeys
+    std::size_t load_karma();
+    ///reads karma of the pubkey from the index
+    std::optional<KarmaTable::Value> read_karma(const Event::Pubkey &k) const;
+
+    ///Candidates of single filter with their ordering
+    using RankedList = std::vector<std::pair<OrderingItem, docdb::DocID> >;
+    ///Finds candidates of single filter, returns false, if the result is inverted (all documents)
+    bool find_ranked(const Filter &filter, RankedList &result) const;
+    ///Counts events using maintained counters, nullopt if the filters have other shape
+    std::optional<std::size_t> count_from_index(const std::vector<Filter> &filters) const;
+    ///Estimates count of events using time buckets, nullopt if not possible or error is too large
+    std::optional<std::size_t> estimate_count(const std::vector<Filter> &filters) const;
+    ///Executes filters in parallel and merges results, nullopt means all documents
+    cocls::future<std::optional<RankedList> > find_ranked_parallel(const std::vector<Filter> &filters);
+
 
     cocls::future<bool> send_infodoc(coroserver::http::ServerRequest &req);
     cocls::future<bool> send_simple_stats(coroserver::http::ServerRequest &req);
     std::size_t run_attachment_gc(ondra_shared::LogObject &lg, std::stop_token stp);
     void start_gc_thread();
+    ///Rewrites events stored without JSON (see EventDocument::Options)
+    std::size_t migrate_json(ondra_shared::LogObject &lg);
     cocls::future<bool> process_nip05_request(coroserver::http::ServerRequest &req, std::string_view vpath);
 
     std::jthread _gc_thread;
     std::atomic<bool> _gc_running = {false};
+    std::jthread _id_filter_thread;
+    std::atomic<bool> _id_filter_rebuilding = {false};
 
     ///contains true if gc is clear - it doesn't need to run, false = dirty, run gc
     std::shared_ptr<std::atomic_flag> _gc_is_clear;
@@ -153,6 +323,15 @@ protected:
     mutable std::mutex _app_share;
     int _clients = 0;
     std::set<std::string, std::less<> > _this_relay_url;
+
+    ///resumes coroutines waiting for the services below, must be destroyed after them
+    Dispatcher _dispatcher;
+    QueryExecutor _query_executor;
+    SignatureVerifier _verifier;
+    ///must be destroyed first, the writer thread uses the storage
+    EventWriter _writer;
+
+    EventWriter::Callbacks writer_callbacks();
 };
 
 
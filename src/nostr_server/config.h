@@ -4,6 +4,8 @@
 #include <string>
 #include <leveldb/options.h>
 #include <optional>
+#include <ctime>
+#include <vector>
 #include <coroserver/ssl_common.h>
 
 namespace nostr_server {
@@ -27,6 +29,8 @@ struct ServerOptions {
     int event_rate_limit = 10;
     std::size_t attachment_max_size = 1*1024*1024;
     std::size_t max_message_size=64*1024;
+    ///count of bytes which can be sent by the replay of stored events before waiting for flush
+    std::size_t replay_buffer_size=256*1024;
     bool read_only;
     bool whitelisting;
     std::string replicators;
@@ -60,8 +64,36 @@ struct Config {
 
     std::string listen_addr;
     int threads;
+    ///count of threads executing queries
+    unsigned int query_threads = 2;
+    ///log plans of queries
+    bool query_explain = false;
+    ///maximum relative error of approximate COUNT (0 - exact count only)
+    double count_max_error = 0;
+    ///size of the cache of query results in bytes (0 - disabled)
+    std::size_t result_cache_size = 8*1024*1024;
+    ///kinds of events kept in memory to answer feed queries
+    std::vector<unsigned int> recent_kinds = {1,6,7};
+    ///maximum count of recent events per kind (0 - disabled)
+    std::size_t recent_count = 2000;
+    ///maximum age of recent events in seconds (0 - no limit)
+    std::time_t recent_max_age = 86400;
+    ///count of threads verifying signatures
+    unsigned int verify_threads = 2;
     std::string web_document_root;
     std::string database_path;
+    ///store canonical JSON with each event (faster replay, larger database)
+    bool store_json = false;
+    ///rewrite existing events to include JSON at startup
+    bool migrate_json = false;
+    ///size of the cache of stored events in bytes (0 - disabled)
+    std::size_t event_cache_size = 16*1024*1024;
+    ///keep filter of stored ids in memory
+    bool id_filter = true;
+    ///maximum count of events committed in one batch (0 - no group commit)
+    std::size_t write_batch = 256;
+    ///maximum time to wait for more events to the batch in microseconds
+    unsigned int write_latency_us = 1000;
 
     std::optional<coroserver::ssl::Certificate> cert;
     std::string ssl_listen_addr;
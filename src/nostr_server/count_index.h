@@ -0,0 +1,88 @@
+/*
+ * count_index.h
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_NOSTR_SERVER_COUNT_INDEX_H_
+#define SRC_NOSTR_SERVER_COUNT_INDEX_H_
+
+#include "event.h"
+#include "iapp.h"
+
+#include <docdb/incremental_aggregator.h>
+#include <algorithm>
+#include <cstdint>
+#include <string_view>
+
+namespace nostr_server {
+
+struct CountDocument {
+    using Type = std::uint32_t;
+    template<typename Iter>
+    static Iter to_binary(const Type &what, Iter at) {
+        const char *from = reinterpret_cast<const char *>(&what);
+        const char *to = from+sizeof(Type);
+        return std::copy(from, to, at);
+    }
+    template<typename Iter>
+    static Type from_binary(Iter &at, Iter end) {
+        Type what = 0;
+        char *from = reinterpret_cast<char *>(&what);
+        char *to = from+sizeof(Type);
+        while(from != to && at != end) {
+            *from = *at;
+            ++from;
+            ++at;
+        }
+        return what;
+    }
+};
+
+///Maintains count of events for each kind and value of a counted tag
+/**
+ * Key is {kind, tag, value}. It answers COUNT for reactions and replies
+ * (kind + #e) and for followers and mentions (kind + #p) without
+ * reading the events
+ */
+struct CountIndexFn {
+    static constexpr int revision = 1;
+    ///tags which are counted
+    static constexpr std::string_view counted_tags = "ep";
+    template<typename Emit>
+    void operator ()(Emit emit, const EventOrAttachment &evatt) const;
+};
+
+using CountIndex = docdb::IncrementalAggregator<IApp::Storage, CountIndexFn, CountDocument>;
+
+///Maintains count of events in time buckets (used to estimate COUNT)
+/**
+ * Counters are kept for all events, for each kind and for each
+ * value of counted tags (see CountIndexFn). Each counter is maintained in
+ * multiple bucket sizes (levels), so a count of a long time range is
+ * summed from few large buckets. Only the buckets on the edges of the range
+ * are partially covered, their count is interpolated.
+ *
+ * Keys:
+ *  {'a', level, bucket} - all events
+ *  {'k', level, kind, bucket} - events of the kind
+ *  {'t', level, tag, value, bucket} - events with the tag value
+ *
+ * Unlike sketches (HyperLogLog), the counters support removal of the events.
+ * The index is maintained only when approximate COUNT is enabled
+ */
+struct TimeBucketCountFn {
+    static constexpr int revision = 2;
+    ///bucket sizes in seconds, every level is multiple of the previous one
+    static constexpr std::time_t levels[] = {3600, 86400, 86400*32, 86400*512};
+    static constexpr unsigned char level_count = sizeof(levels)/sizeof(levels[0]);
+    template<typename Emit>
+    void operator ()(Emit emit, const EventOrAttachment &evatt) const;
+};
+
+using TimeBucketCountIndex = docdb::IncrementalAggregator<IApp::Storage, TimeBucketCountFn, CountDocument>;
+
+}
+
+#endif /* SRC_NOSTR_SERVER_COUNT_INDEX_H_ */
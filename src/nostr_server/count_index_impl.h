@@ -0,0 +1,69 @@
+#include "count_index.h"
+
+#include <vector>
+
+namespace nostr_server {
+
+template<typename Emit>
+void CountIndexFn::operator ()(Emit emit, const EventOrAttachment &evatt) const {
+
+    if (!std::holds_alternative<Event>(evatt)) return;
+    const Event &ev = std::get<Event>(evatt);
+
+    //the event is counted once even if it has duplicated tags
+    std::vector<const Event::Tag *> tags;
+    for (const auto &t: ev.tags) {
+        if (t.tag.size() == 1 && counted_tags.find(t.tag[0]) != counted_tags.npos) {
+            tags.push_back(&t);
+        }
+    }
+    std::sort(tags.begin(), tags.end(), [](const Event::Tag *a, const Event::Tag *b){
+        return a->tag == b->tag?a->content < b->content:a->tag < b->tag;
+    });
+    tags.erase(std::unique(tags.begin(), tags.end(), [](const Event::Tag *a, const Event::Tag *b){
+        return a->tag == b->tag && a->content == b->content;
+    }), tags.end());
+
+    for (const Event::Tag *t: tags) {
+        auto v = emit(docdb::Key(ev.kind, t->tag[0], std::string_view(t->content)));
+        if constexpr(emit.erase) {
+            if (v && *v) v.put(*v - 1);
+        } else {
+            v.put(v?*v + 1:1);
+        }
+    }
+}
+
+template<typename Emit>
+void TimeBucketCountFn::operator ()(Emit emit, const EventOrAttachment &evatt) const {
+
+    if (!std::holds_alternative<Event>(evatt)) return;
+    const Event &ev = std::get<Event>(evatt);
+
+    auto update = [&](const docdb::Key &key) {
+        auto v = emit(key);
+        if constexpr(emit.erase) {
+            if (v && *v) v.put(*v - 1);
+        } else {
+            v.put(v?*v + 1:1);
+        }
+    };
+
+    std::vector<std::pair<char, std::string_view> > tags;
+    for (const auto &t: ev.tags) {
+        if (t.tag.size() == 1 && CountIndexFn::counted_tags.find(t.tag[0]) != CountIndexFn::counted_tags.npos) {
+            tags.push_back({t.tag[0], t.content});
+        }
+    }
+    std::sort(tags.begin(), tags.end());
+    tags.erase(std::unique(tags.begin(), tags.end()), tags.end());
+
+    for (unsigned char l = 0; l < level_count; ++l) {
+        std::time_t bucket = ev.created_at / levels[l];
+        update(docdb::Key('a', l, bucket));
+        update(docdb::Key('k', l, ev.kind, bucket));
+        for (const auto &[t, v]: tags) update(docdb::Key('t', l, t, v, bucket));
+    }
+}
+
+}
@@ -0,0 +1,51 @@
+/*
+ * dispatcher.cpp
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#include "dispatcher.h"
+
+namespace nostr_server {
+
+Dispatcher::Dispatcher(unsigned int threads) {
+    _threads.reserve(threads);
+    for (unsigned int i = 0; i < threads; ++i) {
+        _threads.emplace_back([this]{worker();});
+    }
+}
+
+Dispatcher::~Dispatcher() {
+    {
+        std::lock_guard _(_mx);
+        _exit = true;
+    }
+    _cond.notify_all();
+    for (auto &t: _threads) t.join();
+}
+
+void Dispatcher::enqueue(PTask &&task) {
+    {
+        std::lock_guard _(_mx);
+        _queue.push_back(std::move(task));
+    }
+    _cond.notify_one();
+}
+
+void Dispatcher::worker() {
+    std::unique_lock lk(_mx);
+    while (true) {
+        _cond.wait(lk, [&]{return _exit || !_queue.empty();});
+        //queue is drained before exit, no waiting coroutine is left behind
+        if (_queue.empty()) break;
+        PTask task = std::move(_queue.front());
+        _queue.pop_front();
+        lk.unlock();
+        task->run();
+        task.reset();
+        lk.lock();
+    }
+}
+
+}
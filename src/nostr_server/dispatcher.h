@@ -0,0 +1,101 @@
+/*
+ * dispatcher.h
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_NOSTR_SERVER_DISPATCHER_H_
+#define SRC_NOSTR_SERVER_DISPATCHER_H_
+
+#include <cocls/future.h>
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace nostr_server {
+
+///Threads which resume coroutines waiting for results of background services
+/**
+ * Resolution of a promise resumes the awaiting coroutine in the resolving
+ * thread. Services (query executor, signature verifier, event writer)
+ * resolve their promises through the dispatcher, so code of the peers
+ * doesn't run in their threads and a slow peer doesn't stall the service.
+ *
+ * The dispatcher should be destroyed after the services. Pending
+ * resolutions are executed before the destructor returns
+ */
+class Dispatcher {
+public:
+
+    ///Construct the dispatcher
+    /**
+     * @param threads count of threads. If zero is passed, promises
+     * are resolved directly in the calling thread
+     */
+    Dispatcher(unsigned int threads);
+    ~Dispatcher();
+
+    Dispatcher(const Dispatcher &) = delete;
+    Dispatcher &operator=(const Dispatcher &) = delete;
+
+    ///Resolve the promise in a dispatcher thread
+    /**
+     * @param prom promise
+     * @param args value (or std::exception_ptr), nothing for promise<void>
+     */
+    template<typename T, typename ... Args>
+    void resolve(cocls::promise<T> &&prom, Args && ... args);
+
+protected:
+
+    class AbstractTask {
+    public:
+        virtual ~AbstractTask() = default;
+        virtual void run() = 0;
+    };
+
+    template<typename Fn>
+    class Task: public AbstractTask {
+    public:
+        Task(Fn &&fn):_fn(std::forward<Fn>(fn)) {}
+        virtual void run() override {_fn();}
+    protected:
+        std::decay_t<Fn> _fn;
+    };
+
+    using PTask = std::unique_ptr<AbstractTask>;
+
+    std::mutex _mx;
+    std::condition_variable _cond;
+    std::deque<PTask> _queue;
+    std::vector<std::thread> _threads;
+    bool _exit = false;
+
+    void enqueue(PTask &&task);
+    void worker();
+};
+
+template<typename T, typename ... Args>
+inline void Dispatcher::resolve(cocls::promise<T> &&prom, Args && ... args) {
+    if (_threads.empty()) {
+        prom(std::forward<Args>(args)...);
+        return;
+    }
+    auto fn = [prom = std::move(prom), ...vals = std::forward<Args>(args)]() mutable {
+        prom(std::move(vals)...);
+    };
+    enqueue(std::make_unique<Task<decltype(fn)> >(std::move(fn)));
+}
+
+}
+
+
+
+#endif /* SRC_NOSTR_SERVER_DISPATCHER_H_ */
@@ -3,8 +3,13 @@
 #include <docdb/structured_document.h>
 #include <docdb/json.h>
 #include <openssl/sha.h>
+#include <openssl/evp.h>
 #include <coroserver/static_lookup.h>
 
+#include <cassert>
+#include <charconv>
+#include <memory>
+
 namespace nostr_server {
 
 Event Event::fromJSON(std::string_view json_text)
@@ -128,22 +133,148 @@ docdb::Structured Event::toStructured() const
     return ev;
 }
 
-Event::ID Event::calc_id() const
-{
-    Event::PubkeyHex pubkey_str = author;
+namespace {
+
+///Serializes event into canonical form (NIP-01) and feeds it directly to SHA-256
+/**
+ * Output is collected in a small buffer, which is passed to the hash function
+ * when it is full. No memory is allocated during serialization
+ */
+class CanonicalHasher {
+public:
+    CanonicalHasher() {
+        thread_local std::unique_ptr<EVP_MD_CTX, EVPMDDeleter> ctx(EVP_MD_CTX_new());
+        _ctx = ctx.get();
+        EVP_DigestInit_ex(_ctx, EVP_sha256(), nullptr);
+    }
+
+    void put(char c) {
+        if (_pos == sizeof(_buff)) flush();
+        _buff[_pos++] = c;
+    }
+
+    void put(std::string_view text) {
+        if (text.size() > sizeof(_buff) - _pos) {
+            flush();
+            if (text.size() >= sizeof(_buff)) {
+                EVP_DigestUpdate(_ctx, text.data(), text.size());
+                return;
+            }
+        }
+        std::copy(text.begin(), text.end(), _buff + _pos);
+        _pos += text.size();
+    }
+
+    void put_string(std::string_view text) {
+        put('"');
+        auto beg = text.begin();
+        for (auto iter = text.begin(); iter != text.end(); ++iter) {
+            unsigned char c = static_cast<unsigned char>(*iter);
+            if (c >= 0x20 && c != '"' && c != '\\') continue;
+            put(std::string_view(beg, iter));
+            beg = iter + 1;
+            put('\\');
+            switch (c) {
+                case '"': put('"');break;
+                case '\\': put('\\');break;
+                case '\n': put('n');break;
+                case '\r': put('r');break;
+                case '\t': put('t');break;
+                case '\b': put('b');break;
+                case '\f': put('f');break;
+                default: {
+                    constexpr char hexletters[] = "0123456789abcdef";
+                    put("u00");
+                    put(hexletters[c >> 4]);
+                    put(hexletters[c & 0xF]);
+                }
+            }
+        }
+        put(std::string_view(beg, text.end()));
+        put('"');
+    }
+
+    template<typename T>
+    void put_number(T val) {
+        char buff[24];
+        auto res = std::to_chars(buff, buff+sizeof(buff), val);
+        put(std::string_view(buff, res.ptr - buff));
+    }
+
+    Event::ID finish() {
+        flush();
+        Event::ID hash;
+        EVP_DigestFinal_ex(_ctx, hash.data(), nullptr);
+        return hash;
+    }
+
+protected:
+    struct EVPMDDeleter {
+        void operator()(EVP_MD_CTX *ctx) const {EVP_MD_CTX_free(ctx);}
+    };
+
+    EVP_MD_CTX *_ctx;
+    char _buff[256];
+    std::size_t _pos = 0;
+
+    void flush() {
+        if (_pos) EVP_DigestUpdate(_ctx, _buff, _pos);
+        _pos = 0;
+    }
+};
+
+#ifndef NDEBUG
+///Original implementation - used to check the canonical serializer in debug build
+Event::ID calc_id_structured(const Event &ev) {
+    Event::PubkeyHex pubkey_str = ev.author;
     docdb::Structured eventToSign = {
         0,
         std::string_view(pubkey_str.data(), pubkey_str.size()),
-        created_at,
-        kind,
-        build_tags(*this),
-        std::string_view(content)
+        ev.created_at,
+        ev.kind,
+        build_tags(ev),
+        std::string_view(ev.content)
     };
     std::string eventData = eventToSign.to_json(docdb::Structured::flagUTF8);
     Event::ID hash;
     SHA256(reinterpret_cast<const uint8_t*>(eventData.data()), eventData.size(), hash.data());
     return hash;
 }
+#endif
+
+}
+
+Event::ID Event::calc_id() const
+{
+    Event::PubkeyHex pubkey_str = author;
+    CanonicalHasher out;
+    out.put("[0,\"");
+    out.put(std::string_view(pubkey_str.data(), pubkey_str.size()));
+    out.put("\",");
+    out.put_number(created_at);
+    out.put(',');
+    out.put_number(kind);
+    out.put(",[");
+    for (std::size_t i = 0; i < tags.size(); ++i) {
+        const Tag &t = tags[i];
+        if (i) out.put(',');
+        out.put('[');
+        out.put_string(t.tag);
+        out.put(',');
+        out.put_string(t.content);
+        for (const auto &x: t.additional_content) {
+            out.put(',');
+            out.put_string(x);
+        }
+        out.put(']');
+    }
+    out.put("],");
+    out.put_string(content);
+    out.put(']');
+    Event::ID hash = out.finish();
+    assert(hash == calc_id_structured(*this));
+    return hash;
+}
 
 bool Event::verify(const SignatureTools &sigtool) const
 {
@@ -7,6 +7,7 @@
 #include <docdb/row.h>
 #include <docdb/structured_document.h>
 
+#include <algorithm>
 #include <array>
 #include <cstdint>
 #include <string>
@@ -96,6 +97,40 @@ using EventOrAttachment = std::variant<Event, Attachment>;
 struct EventDocument {
     using Srl = docdb::StructuredDocument<>;
     using Type = EventOrAttachment;
+
+    //When Options::store_json is set, canonical JSON is stored after the binary form.
+    //Record is then <binary form><json><json_size:4><json_marker>. Records
+    //without JSON are still readable, so the option can be turned on any time.
+    //Replay sends stored JSON without rendering (see find_json())
+
+    ///Options of the serialization
+    struct Options {
+        ///store canonical JSON with the event
+        bool store_json;
+    };
+
+    ///Sets options of documents written by the current thread
+    /**
+     * The storage calls to_binary() in the writing thread, so the writer
+     * sets the options of its storage for the duration of the write
+     */
+    class OptionsScope {
+    public:
+        explicit OptionsScope(const Options &opt):_prev(_options) {_options = opt;}
+        ~OptionsScope() {_options = _prev;}
+        OptionsScope(const OptionsScope &) = delete;
+        OptionsScope &operator=(const OptionsScope &) = delete;
+    protected:
+        Options _prev;
+    };
+
+    ///last byte of the record with JSON. Records without JSON end by ref_level
+    static constexpr unsigned char json_marker = 0xFF;
+    ///size of json_size and json_marker
+    static constexpr std::size_t json_suffix_size = 5;
+    ///ref_level is limited, so it is never confused with the json_marker
+    static constexpr Event::Depth max_ref_level = json_marker - 1;
+
     template<typename Iter>
     static Iter to_binary(const EventOrAttachment &evatt, Iter out) {
         *out = static_cast<char>(evatt.index());
@@ -116,7 +151,14 @@ struct EventDocument {
             std::copy(ev.id.begin(), ev.id.end(), out);
             std::copy(ev.author.begin(), ev.author.end(), out);
             std::copy(ev.sig.begin(), ev.sig.end(), out);
-            *out++=ev.ref_level;
+            *out++=std::min(ev.ref_level, max_ref_level);
+            if (_options.store_json) {
+                std::string json = ev.toStructured().to_json(docdb::Structured::flagUTF8);
+                out = std::copy(json.begin(), json.end(), out);
+                auto sz = static_cast<std::uint32_t>(json.size());
+                for (int i = 0; i < 4; ++i) *out++ = static_cast<char>((sz >> (8*i)) & 0xFF);
+                *out++ = static_cast<char>(json_marker);
+            }
         } else {
             const Attachment &att = std::get<Attachment>(evatt);
             out = std::copy(att.id.begin(), att.id.end(), out);
@@ -175,6 +217,29 @@ struct EventDocument {
         }
      }
 
+    ///Retrieves stored JSON of the event
+    /**
+     * @param data serialized record
+     * @return canonical JSON of the event (without karma and file_url). Returns
+     * empty string if the record has no JSON
+     */
+    static std::string_view find_json(std::string_view data) {
+        //type, flags, id, author, sig and ref_level are always present
+        constexpr std::size_t min_event_size = 2+32+32+64+1;
+        if (data.size() < min_event_size + json_suffix_size
+                || data[0] != 0
+                || static_cast<unsigned char>(data.back()) != json_marker) return {};
+        std::size_t pos = data.size() - json_suffix_size;
+        std::size_t sz = 0;
+        for (int i = 0; i < 4; ++i) {
+            sz |= static_cast<std::size_t>(static_cast<unsigned char>(data[pos+i])) << (8*i);
+        }
+        if (sz + min_event_size > pos) return {};
+        std::string_view json = data.substr(pos - sz, sz);
+        if (json.empty() || json.front() != '{' || json.back() != '}') return {};
+        return json;
+    }
+
     template<typename Iter>
     static unsigned char get_extra(Iter &at, Iter end) {
         if (at == end) return 0;
@@ -192,6 +257,9 @@ struct EventDocument {
         }
     }
 
+protected:
+    ///options of the current thread (see OptionsScope), all disabled by default
+    static inline thread_local Options _options = {false};
 };
 
 
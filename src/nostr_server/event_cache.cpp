@@ -0,0 +1,65 @@
+/*
+ * event_cache.cpp
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#include "event_cache.h"
+
+namespace nostr_server {
+
+EventCache::EventCache(std::size_t max_size, unsigned int shards)
+    :_shards(max_size && shards?shards:0)
+    ,_shard_limit(shards?max_size / shards:0) {}
+
+EventCache::PEvent EventCache::find(docdb::DocID id) {
+    if (_shards.empty()) return nullptr;
+    Shard &shard = get_shard(id);
+    std::lock_guard _(shard.mx);
+    auto iter = shard.map.find(id);
+    if (iter == shard.map.end()) {
+        ++_misses;
+        return nullptr;
+    }
+    ++_hits;
+    //move to front, the most recently used
+    shard.lru.splice(shard.lru.begin(), shard.lru, iter->second);
+    return iter->second->second;
+}
+
+void EventCache::put(docdb::DocID id, PEvent ev) {
+    if (_shards.empty() || !ev) return;
+    std::size_t sz = entry_size(ev);
+    if (sz > _shard_limit) return;
+    Shard &shard = get_shard(id);
+    std::lock_guard _(shard.mx);
+    auto iter = shard.map.find(id);
+    if (iter != shard.map.end()) remove(shard, iter->second);
+    shard.lru.emplace_front(id, std::move(ev));
+    shard.map.emplace(id, shard.lru.begin());
+    shard.size += sz;
+    _size += sz;
+    while (shard.size > _shard_limit) {
+        remove(shard, std::prev(shard.lru.end()));
+        ++_evictions;
+    }
+}
+
+void EventCache::invalidate(docdb::DocID id) {
+    if (_shards.empty()) return;
+    Shard &shard = get_shard(id);
+    std::lock_guard _(shard.mx);
+    auto iter = shard.map.find(id);
+    if (iter != shard.map.end()) remove(shard, iter->second);
+}
+
+void EventCache::remove(Shard &shard, LRUList::iterator iter) {
+    std::size_t sz = entry_size(iter->second);
+    shard.size -= sz;
+    _size -= sz;
+    shard.map.erase(iter->first);
+    shard.lru.erase(iter);
+}
+
+}
@@ -0,0 +1,95 @@
+/*
+ * event_cache.h
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_NOSTR_SERVER_EVENT_CACHE_H_
+#define SRC_NOSTR_SERVER_EVENT_CACHE_H_
+#include "event_view.h"
+
+#include <docdb/database.h>
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace nostr_server {
+
+///Cache of stored events shared by all peers
+/**
+ * Events are cached by DocID. Content of the document never changes
+ * under the same DocID (update creates new document), so the cache
+ * needs to be invalidated only when the document is replaced or erased
+ * (see invalidate())
+ *
+ * The cache is divided into shards, each shard has own lock and own LRU list.
+ * Size of the cache is limited by total size of the serialized events.
+ */
+class EventCache {
+public:
+
+    using PEvent = std::shared_ptr<const EventView>;
+
+    ///Construct the cache
+    /**
+     * @param max_size maximum size in bytes. If zero is passed, the cache is disabled
+     * @param shards count of shards
+     */
+    explicit EventCache(std::size_t max_size, unsigned int shards = 16);
+
+    ///Find event in the cache
+    /**
+     * @param id document id
+     * @return cached event or nullptr
+     */
+    PEvent find(docdb::DocID id);
+    ///Put event to the cache
+    void put(docdb::DocID id, PEvent ev);
+    ///Remove the document from the cache
+    void invalidate(docdb::DocID id);
+
+    bool is_enabled() const {return !_shards.empty();}
+
+    std::size_t get_hits() const {return _hits;}
+    std::size_t get_misses() const {return _misses;}
+    std::size_t get_evictions() const {return _evictions;}
+    ///Current size of cached events in bytes
+    std::size_t get_size() const {return _size;}
+
+protected:
+
+    ///approximate memory used by an entry beside the event data
+    static constexpr std::size_t entry_overhead = 128;
+
+    using LRUList = std::list<std::pair<docdb::DocID, PEvent> >;
+
+    struct Shard {
+        std::mutex mx;
+        LRUList lru;
+        std::unordered_map<docdb::DocID, LRUList::iterator> map;
+        std::size_t size = 0;
+    };
+
+    std::vector<Shard> _shards;
+    std::size_t _shard_limit = 0;
+
+    std::atomic<std::size_t> _hits = 0;
+    std::atomic<std::size_t> _misses = 0;
+    std::atomic<std::size_t> _evictions = 0;
+    std::atomic<std::size_t> _size = 0;
+
+    Shard &get_shard(docdb::DocID id) {return _shards[id % _shards.size()];}
+    static std::size_t entry_size(const PEvent &ev) {return ev->data().size() + entry_overhead;}
+    void remove(Shard &shard, LRUList::iterator iter);
+};
+
+}
+
+
+
+#endif /* SRC_NOSTR_SERVER_EVENT_CACHE_H_ */
@@ -0,0 +1,63 @@
+/*
+ * event_view.cpp
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#include "event_view.h"
+
+#include <algorithm>
+
+namespace nostr_server {
+
+std::string_view EventView::read_string(const char *&at, const char *end) {
+    //string is serialized as its length followed by the bytes
+    auto x = EventDocument::get_extra(at, end);
+    std::size_t len = Srl::uint_from_binary(x, at, end);
+    len = std::min<std::size_t>(len, end - at);
+    std::string_view r(at, len);
+    at += len;
+    return r;
+}
+
+EventView::EventView(std::string data):_data(std::move(data)) {
+    if (_data.size() < trailer_size + 2 || _data[0] != 0) return;
+    _json_size = EventDocument::find_json(_data).size();
+    _binary_size = _data.size() - (_json_size?_json_size + EventDocument::json_suffix_size:0);
+    const char *at = _data.data()+1;
+    const char *end = _data.data() + _binary_size - trailer_size;
+    nip97 = (static_cast<unsigned char>(*at) & 0x80) != 0;
+    read_string(at, end);   //content
+    auto x = EventDocument::get_extra(at, end);
+    kind = Srl::uint_from_binary(x, at, end);
+    x = EventDocument::get_extra(at, end);
+    created_at = Srl::uint_from_binary(x, at, end);
+    x = EventDocument::get_extra(at, end);
+    _tag_count = Srl::uint_from_binary(x, at, end);
+    _tags_offset = at - _data.data();
+    const char *trailer = end;
+    std::copy(trailer, trailer+id.size(), id.begin());
+    trailer += id.size();
+    std::copy(trailer, trailer+author.size(), author.begin());
+    _event = true;
+}
+
+bool EventView::has_indexed_tag(char t, std::string_view content) const {
+    bool found = false;
+    for_each_tag([&](std::string_view name, std::string_view value){
+        found = name.size() == 1 && name[0] == t && value == content;
+        return !found;
+    });
+    return found;
+}
+
+FlatEvent EventView::decode() const {
+    const char *at = _data.data();
+    const char *end = at + _data.size();
+    auto evatt = FlatEventDocument::from_binary(at, end);
+    if (!std::holds_alternative<FlatEvent>(evatt)) return FlatEvent();
+    return std::move(std::get<FlatEvent>(evatt));
+}
+
+}
@@ -0,0 +1,119 @@
+/*
+ * event_view.h
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_NOSTR_SERVER_EVENT_VIEW_H_
+#define SRC_NOSTR_SERVER_EVENT_VIEW_H_
+#include "flat_event.h"
+
+#include <string>
+#include <string_view>
+
+namespace nostr_server {
+
+///Read-only view to the serialized event
+/**
+ * The view doesn't decode the event. It reads kind and created_at from the
+ * header, id and author are read from fixed offsets at the end of the
+ * record. Tags are parsed lazily during the search. It is intended to test
+ * candidates by the filter, only accepted events are decoded (decode())
+ *
+ * Serialized layout (see EventDocument)
+ * @code
+ * <0><flags><content><kind><created_at><tag_count><tags...><id:32><author:32><sig:64><ref_level:1>[<json><json_size:4><0xFF>]
+ * @endcode
+ */
+class EventView {
+public:
+
+    Event::Kind kind = 0;
+    std::time_t created_at = 0;
+    Event::ID id;
+    Event::Pubkey author;
+    bool nip97 = false;
+
+    EventView() = default;
+    ///Construct view
+    /**
+     * @param data serialized form of EventOrAttachment
+     */
+    explicit EventView(std::string data);
+
+    ///Returns true, if the record is valid event (not an attachment)
+    bool is_event() const {return _event;}
+
+    ///Enumerate tags
+    /**
+     * @param fn function called with (tag name, tag value). Function returns
+     * true to continue, false to stop
+     */
+    template<typename Fn>
+    void for_each_tag(Fn &&fn) const;
+
+    ///Search tag by name and value (same as Event::find_indexed_tag)
+    bool has_indexed_tag(char t, std::string_view content) const;
+
+    ///Fully decode the event
+    FlatEvent decode() const;
+
+    ///Serialized form
+    std::string_view data() const {return _data;}
+
+    ///Stored canonical JSON, empty if the record has no JSON (see EventDocument::Options)
+    std::string_view json() const {return std::string_view(_data).substr(_binary_size, _json_size);}
+
+protected:
+    using Srl = docdb::StructuredDocument<>;
+    ///size of id, author, sig and ref_level at the end of record
+    static constexpr std::size_t trailer_size = 32+32+64+1;
+
+    std::string _data;
+    ///end of the binary part (start of stored JSON)
+    std::size_t _binary_size = 0;
+    std::size_t _json_size = 0;
+    std::size_t _tags_offset = 0;
+    std::size_t _tag_count = 0;
+    bool _event = false;
+
+    static std::string_view read_string(const char *&at, const char *end);
+};
+
+///Document definition which provides EventView over stored records
+struct EventViewDocument {
+    using Type = EventView;
+
+    template<typename Iter>
+    static Iter to_binary(const EventView &view, Iter out) {
+        auto d = view.data();
+        return std::copy(d.begin(), d.end(), out);
+    }
+    template<typename Iter>
+    static EventView from_binary(Iter &at, Iter end) {
+        std::string data(at, end);
+        at = end;
+        return EventView(std::move(data));
+    }
+};
+
+template<typename Fn>
+inline void EventView::for_each_tag(Fn &&fn) const {
+    const char *at = _data.data() + _tags_offset;
+    const char *end = _data.data() + _binary_size - trailer_size;
+    for (std::size_t i = 0; i < _tag_count && at < end; ++i) {
+        std::string_view name = read_string(at, end);
+        std::string_view value = read_string(at, end);
+        auto x = EventDocument::get_extra(at, end);
+        std::size_t add_count = Srl::uint_from_binary(x, at, end);
+        for (std::size_t j = 0; j < add_count; ++j) read_string(at, end);
+        if (!fn(name, value)) break;
+    }
+}
+
+}
+
+
+
+#endif /* SRC_NOSTR_SERVER_EVENT_VIEW_H_ */
@@ -0,0 +1,175 @@
+/*
+ * event_writer.cpp
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#include "event_writer.h"
+#include "kinds.h"
+
+#include <algorithm>
+#include <optional>
+
+namespace nostr_server {
+
+EventWriter::EventWriter(Callbacks cb, Dispatcher &dispatcher, std::size_t max_batch, std::chrono::microseconds max_latency)
+    :_cb(std::move(cb))
+    ,_dispatcher(dispatcher)
+    ,_max_batch(max_batch)
+    ,_max_latency(max_latency) {
+    if (_max_batch) {
+        _thread = std::thread([this]{worker();});
+    }
+}
+
+EventWriter::~EventWriter() {
+    if (_thread.joinable()) {
+        {
+            std::lock_guard _(_mx);
+            _exit = true;
+        }
+        _cond.notify_all();
+        _thread.join();
+    }
+}
+
+cocls::future<void> EventWriter::write(Event &&ev, const void *publisher) {
+    return [&](cocls::promise<void> prom) {
+        if (!_thread.joinable()) {
+            std::vector<Request> group;
+            group.push_back(Request{std::move(ev), publisher, std::move(prom)});
+            {
+                std::lock_guard _(_direct_mx);
+                process(group);
+            }
+            resolve(group, nullptr);
+            return;
+        }
+        {
+            std::lock_guard _(_mx);
+            _queue.push_back(Request{std::move(ev), publisher, std::move(prom)});
+            ++_queue_depth;
+        }
+        _cond.notify_one();
+    };
+}
+
+void EventWriter::worker() {
+    std::vector<Request> group;
+    bool full = false;
+    std::unique_lock lk(_mx);
+    while (true) {
+        _cond.wait(lk, [&]{return _exit || !_queue.empty();});
+        if (_exit) break;
+        //idle writer commits at once, events received during the commit form the next group.
+        //Only under load (previous group was full) other peers get a chance to join the batch
+        if (full && _queue.size() < _max_batch && _max_latency.count()) {
+            _cond.wait_for(lk, _max_latency, [&]{return _exit || _queue.size() >= _max_batch;});
+        }
+        while (!_queue.empty() && group.size() < _max_batch) {
+            group.push_back(std::move(_queue.front()));
+            _queue.pop_front();
+            --_queue_depth;
+        }
+        full = group.size() >= _max_batch;
+        lk.unlock();
+        process(group);
+        //awaiting coroutines are resumed by the dispatcher
+        resolve(group, &_dispatcher);
+        group.clear();
+        lk.lock();
+    }
+}
+
+void EventWriter::process(std::vector<Request> &group) {
+    std::optional<docdb::Batch> b;
+    std::vector<Event::ID> ids;
+    std::vector<std::string> keys;
+    std::size_t begin = 0;
+    std::size_t i = 0;
+    b.emplace();
+    while (i < group.size()) {
+        Request &r = group[i];
+        if (r.error) {
+            ++i;
+            continue;
+        }
+        std::string k = conflict_key(r.ev);
+        bool conflict = std::find(ids.begin(), ids.end(), r.ev.id) != ids.end()
+                || (!k.empty() && std::find(keys.begin(), keys.end(), k) != keys.end());
+        if (conflict) {
+            //the event depends on the batch, it must be committed first
+            commit(*b, group, begin, i);
+            b.emplace();
+            ids.clear();
+            keys.clear();
+            begin = i;
+        }
+        try {
+            r.stored = _cb.write(*b, r.ev);
+            ids.push_back(r.ev.id);
+            if (!k.empty()) keys.push_back(std::move(k));
+            ++i;
+        } catch (...) {
+            r.error = std::current_exception();
+            //the batch can contain partial write, write other events again
+            _cb.rollback();
+            b.emplace();
+            ids.clear();
+            keys.clear();
+            i = begin;
+        }
+    }
+    commit(*b, group, begin, group.size());
+}
+
+void EventWriter::commit(docdb::Batch &b, std::vector<Request> &group, std::size_t from, std::size_t to) {
+    if (from == to) return;
+    auto start = Clock::now();
+    try {
+        _cb.commit(b);
+    } catch (...) {
+        _cb.rollback();
+        auto e = std::current_exception();
+        for (std::size_t i = from; i < to; ++i) {
+            if (!group[i].error) group[i].error = e;
+        }
+        return;
+    }
+    auto dur = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+    _commit_time_us += dur.count();
+    ++_batches;
+    for (std::size_t i = from; i < to; ++i) {
+        Request &r = group[i];
+        if (r.error) continue;
+        ++_events;
+        if (r.stored) _cb.publish(std::move(r.ev), r.publisher);
+    }
+}
+
+void EventWriter::resolve(std::vector<Request> &group, Dispatcher *disp) {
+    for (Request &r: group) {
+        if (disp) {
+            if (r.error) disp->resolve(std::move(r.result), r.error);
+            else disp->resolve(std::move(r.result));
+        } else {
+            if (r.error) r.result(r.error);
+            else r.result();
+        }
+    }
+}
+
+std::string EventWriter::conflict_key(const Event &ev) {
+    std::string out;
+    bool replacable_1 = (ev.kind == kind::Metadata) | (ev.kind == kind::Contacts)
+                       | ((ev.kind >= kind::Replaceable_Begin) & (ev.kind < kind::Replaceable_End));
+    bool replacable_2 = (ev.kind >= kind::Parameterized_Replaceable_Begin) & (ev.kind < kind::Parameterized_Replaceable_End);
+    if (!replacable_1 && !replacable_2) return out;
+    out.append(reinterpret_cast<const char *>(ev.author.data()), ev.author.size());
+    out.append(reinterpret_cast<const char *>(&ev.kind), sizeof(ev.kind));
+    if (replacable_2) out.append(ev.get_tag_content("d"));
+    return out;
+}
+
+}
@@ -0,0 +1,147 @@
+/*
+ * event_writer.h
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_NOSTR_SERVER_EVENT_WRITER_H_
+#define SRC_NOSTR_SERVER_EVENT_WRITER_H_
+
+#include "dispatcher.h"
+#include "event.h"
+
+#include <docdb/database.h>
+#include <cocls/future.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace nostr_server {
+
+///Single writer, which stores events in groups (group commit)
+/**
+ * Peers enqueue verified events and receive a future. The writer thread
+ * takes all queued events and writes them into one batch, which is
+ * committed at once. Events received during the commit form the next
+ * batch, so a single sender is not delayed. Then the events are
+ * published and the futures are resolved.
+ *
+ * Events which depend on each other (same id, same replaceable event)
+ * are never written in the same batch, the batch is committed before
+ * the dependent event is written.
+ *
+ * Awaiting coroutines are resumed by the dispatcher, so the writer thread
+ * only writes
+ */
+class EventWriter {
+public:
+
+    ///Writes the event to the batch
+    /**
+     * @return true stored, false not stored (outdated replaceable event)
+     * @exception any exception rejects the event, the batch is discarded
+     * and the other events are written again
+     */
+    using WriteFn = std::function<bool(docdb::Batch &, const Event &)>;
+    ///Commits the batch
+    using CommitFn = std::function<void(docdb::Batch &)>;
+    ///Called when the batch is discarded
+    using RollbackFn = std::function<void()>;
+    ///Publishes committed event
+    using PublishFn = std::function<void(Event &&, const void *)>;
+
+    struct Callbacks {
+        WriteFn write;
+        CommitFn commit;
+        RollbackFn rollback;
+        PublishFn publish;
+    };
+
+    ///Construct the writer
+    /**
+     * @param cb callbacks
+     * @param dispatcher dispatcher which resumes awaiting coroutines
+     * @param max_batch maximum count of events in one batch. If zero is
+     * passed, the writer thread is not started and events are written
+     * (and the futures resolved) in the calling thread
+     * @param max_latency maximum time to wait for more events, when the
+     * previous batch was full. Idle writer doesn't wait
+     */
+    EventWriter(Callbacks cb, Dispatcher &dispatcher, std::size_t max_batch, std::chrono::microseconds max_latency);
+    ~EventWriter();
+
+    EventWriter(const EventWriter &) = delete;
+    EventWriter &operator=(const EventWriter &) = delete;
+
+    ///Store and publish the event
+    /**
+     * @param ev event
+     * @param publisher publisher (see EventSource)
+     * @return future resolved after the event is committed and published.
+     * Exception thrown by the write is passed to the future
+     */
+    cocls::future<void> write(Event &&ev, const void *publisher);
+
+    ///Count of events waiting in the queue
+    std::size_t get_queue_depth() const {return _queue_depth;}
+    ///Count of committed batches
+    std::size_t get_batches() const {return _batches;}
+    ///Count of written events
+    std::size_t get_events() const {return _events;}
+    ///Total time spent by commits (seconds)
+    double get_commit_time() const {return _commit_time_us * 0.000001;}
+
+protected:
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Request {
+        Event ev;
+        const void *publisher;
+        cocls::promise<void> result;
+        bool stored = false;
+        std::exception_ptr error;
+    };
+
+    Callbacks _cb;
+    Dispatcher &_dispatcher;
+    std::size_t _max_batch;
+    std::chrono::microseconds _max_latency;
+    std::mutex _mx;
+    std::condition_variable _cond;
+    std::deque<Request> _queue;
+    std::thread _thread;
+    bool _exit = false;
+    ///serializes writes in the calling thread, when there is no writer thread
+    std::mutex _direct_mx;
+
+    std::atomic<std::size_t> _queue_depth = 0;
+    std::atomic<std::size_t> _batches = 0;
+    std::atomic<std::size_t> _events = 0;
+    std::atomic<std::uint64_t> _commit_time_us = 0;
+
+    void worker();
+    ///writes and commits the group (doesn't resolve requests)
+    void process(std::vector<Request> &group);
+    ///commits the batch and publishes stored events
+    void commit(docdb::Batch &b, std::vector<Request> &group, std::size_t from, std::size_t to);
+    ///resolves requests, through the dispatcher, if it is passed
+    static void resolve(std::vector<Request> &group, Dispatcher *disp);
+    ///identifies replaceable events, which can't be written into the same batch (empty for other events)
+    static std::string conflict_key(const Event &ev);
+};
+
+}
+
+
+
+#endif /* SRC_NOSTR_SERVER_EVENT_WRITER_H_ */
@@ -9,45 +9,223 @@
 
 #include "filter.h"
 
+#include <algorithm>
+#include <functional>
+
 namespace nostr_server {
 
-template<typename V>
-auto cmp_shorten(const V &v) {
-    return [&](const auto &x) {
-        unsigned int count = x.second;
-        const auto chk = x.first;
-        auto chk_beg = chk.begin();
-        auto chk_end = chk_beg;
-        std::advance(chk_end, count);
-        return std::equal(chk_beg, chk_end, v.begin());
-    };
+static bool has_tag(const Event &doc, char t, std::string_view c) {
+    return doc.find_indexed_tag(t,c) != nullptr;
 }
 
+static bool has_tag(const FlatEvent &doc, char t, std::string_view c) {
+    return doc.has_indexed_tag(t,c);
+}
 
-bool Filter::test(const Event &doc) const {
-try {
-    if (!authors.empty() && std::find_if(authors.begin(), authors.end(), cmp_shorten(doc.author)) == authors.end()) return false;
-    if (!ids.empty() && std::find_if(ids.begin(), ids.end(), cmp_shorten(doc.id)) == ids.end()) return false;
-    if (!kinds.empty() && std::find(kinds.begin(), kinds.end(), doc.kind) == kinds.end()) return false;
-    for (const auto &[t, contents]: tags) {
-        const Event::Tag *f  = nullptr;
-        for (const auto &c : contents) {
-            f = doc.find_indexed_tag(t,c);
-            if (f) break;
+static bool has_tag(const EventView &doc, char t, std::string_view c) {
+    return doc.has_indexed_tag(t,c);
+}
+
+///Enumerates tags, which can be found by has_tag (single letter tags)
+template<typename Fn>
+static void for_each_indexed_tag(const Event &doc, Fn &&fn) {
+    //tags are not searchable until the hash map is built (see find_indexed_tag)
+    if (doc.tag_hash_map.empty()) return;
+    for (const auto &t: doc.tags) {
+        if (t.tag.size() == 1 && !fn(t.tag[0], std::string_view(t.content))) return;
+    }
+}
+
+template<typename Fn>
+static void for_each_indexed_tag(const FlatEvent &doc, Fn &&fn) {
+    FlatEvent::HexBuffer tmp;
+    for (std::size_t i = 0, cnt = doc.tag_count(); i < cnt; ++i) {
+        std::string_view name = doc.tag_string(i, 0, tmp);
+        if (name.size() == 1 && !fn(name[0], doc.tag_string(i, 1, tmp))) return;
+    }
+}
+
+template<typename Fn>
+static void for_each_indexed_tag(const EventView &doc, Fn &&fn) {
+    doc.for_each_tag([&](std::string_view name, std::string_view value){
+        return name.size() != 1 || fn(name[0], value);
+    });
+}
+
+///Set of binary keys, which can be shortened (prefix search)
+template<std::size_t N>
+class KeySet {
+public:
+    using Key = Binary<N>;
+
+    bool empty() const {return !_match_all && _full.empty() && _prefixes.empty();}
+
+    void add(const Key &k, unsigned char len) {
+        if (len == 0) {
+            //empty prefix matches everything
+            _match_all = true;
+        } else if (len >= N) {
+            _full.push_back(k);
+        } else {
+            auto iter = std::find_if(_prefixes.begin(), _prefixes.end(), [&](const auto &x){return x.first == len;});
+            if (iter == _prefixes.end()) iter = _prefixes.insert(_prefixes.end(), {len, {}});
+            iter->second.push_back(mask(k, len));
         }
-        if (!f) return false;
     }
-    if (since.has_value()) {
-        if (doc.created_at < *since) return false;
+
+    void finish() {
+        sort_unique(_full);
+        for (auto &[len, keys]: _prefixes) sort_unique(keys);
+    }
+
+    bool test(const Key &k) const {
+        if (_match_all) return true;
+        if (std::binary_search(_full.begin(), _full.end(), k)) return true;
+        //prefixes are grouped by length, one search for each length
+        for (const auto &[len, keys]: _prefixes) {
+            if (std::binary_search(keys.begin(), keys.end(), mask(k, len))) return true;
+        }
+        return false;
     }
-    if (until.has_value()) {
-        if (doc.created_at > *until) return false;
+
+protected:
+    bool _match_all = false;
+    std::vector<Key> _full;
+    std::vector<std::pair<unsigned char, std::vector<Key> > > _prefixes;
+
+    static Key mask(const Key &k, unsigned char len) {
+        Key r = k;
+        std::fill(r.begin()+len, r.end(), 0);
+        return r;
+    }
+    static void sort_unique(std::vector<Key> &v) {
+        std::sort(v.begin(), v.end());
+        v.erase(std::unique(v.begin(), v.end()), v.end());
+    }
+};
+
+class Filter::Compiled {
+public:
+    explicit Compiled(const Filter &f);
+
+    template<typename EventType>
+    bool test(const EventType &doc) const;
+
+protected:
+    ///tags with fewer values are tested by has_tag, otherwise tags of the event are enumerated
+    static constexpr std::size_t probe_limit = 4;
+    ///kinds below this limit are stored in the bitmap
+    static constexpr Event::Kind kind_bitmap_limit = 65536;
+
+    struct TagSet {
+        char tag;
+        std::vector<std::string> values;
+    };
+
+    KeySet<32> _authors;
+    KeySet<32> _ids;
+    bool _test_kinds;
+    std::vector<bool> _kind_bitmap;
+    std::vector<Event::Kind> _large_kinds;
+    std::vector<TagSet> _tags;
+
+    bool test_kind(Event::Kind k) const {
+        if (k < _kind_bitmap.size()) return _kind_bitmap[k];
+        return std::binary_search(_large_kinds.begin(), _large_kinds.end(), k);
+    }
+};
+
+Filter::Compiled::Compiled(const Filter &f):_test_kinds(!f.kinds.empty()) {
+    for (const auto &[k, len]: f.authors) _authors.add(k, len);
+    _authors.finish();
+    for (const auto &[k, len]: f.ids) _ids.add(k, len);
+    _ids.finish();
+    for (auto k: f.kinds) {
+        if (k < kind_bitmap_limit) {
+            if (k >= _kind_bitmap.size()) _kind_bitmap.resize(k+1, false);
+            _kind_bitmap[k] = true;
+        } else {
+            _large_kinds.push_back(k);
+        }
+    }
+    std::sort(_large_kinds.begin(), _large_kinds.end());
+    _tags.reserve(f.tags.size());
+    for (const auto &[t, contents]: f.tags) {
+        TagSet ts{t, contents};
+        std::sort(ts.values.begin(), ts.values.end());
+        ts.values.erase(std::unique(ts.values.begin(), ts.values.end()), ts.values.end());
+        _tags.push_back(std::move(ts));
+    }
+}
+
+template<typename EventType>
+bool Filter::Compiled::test(const EventType &doc) const {
+    if (!_authors.empty() && !_authors.test(doc.author)) return false;
+    if (!_ids.empty() && !_ids.test(doc.id)) return false;
+    if (_test_kinds && !test_kind(doc.kind)) return false;
+    for (const auto &ts: _tags) {
+        bool f = false;
+        if (ts.values.size() <= probe_limit) {
+            f = std::any_of(ts.values.begin(), ts.values.end(), [&](const std::string &c){
+                return has_tag(doc, ts.tag, c);
+            });
+        } else {
+            for_each_indexed_tag(doc, [&](char t, std::string_view c){
+                f = t == ts.tag && std::binary_search(ts.values.begin(), ts.values.end(), c, std::less<>());
+                return !f;
+            });
+        }
+        if (!f) return false;
     }
     return true;
-} catch (...) {
-    return false;
 }
 
+Filter::CompiledHolder &Filter::CompiledHolder::operator=(const CompiledHolder &other) {
+    if (this != &other) reset();
+    return *this;
+}
+
+Filter::CompiledHolder::~CompiledHolder() {
+    reset();
+}
+
+void Filter::CompiledHolder::reset() {
+    delete _ptr.exchange(nullptr, std::memory_order_acquire);
+}
+
+const Filter::Compiled &Filter::CompiledHolder::get(const Filter &f) const {
+    const Compiled *c = _ptr.load(std::memory_order_acquire);
+    if (c) return *c;
+    //concurrent tests can compile at the same time, only one state is kept
+    auto nc = std::make_unique<const Compiled>(f);
+    if (_ptr.compare_exchange_strong(c, nc.get(), std::memory_order_acq_rel, std::memory_order_acquire)) {
+        return *nc.release();
+    }
+    return *c;
+}
+
+void Filter::compile() {
+    _compiled.reset();
+    _compiled.get(*this);
+}
+
+bool Filter::test(const Event &doc) const {
+    return test_event(doc);
+}
+
+bool Filter::test(const FlatEvent &doc) const {
+    return test_event(doc);
+}
+
+bool Filter::test(const EventView &doc) const {
+    return doc.is_event() && test_event(doc);
+}
+
+template<typename EventType>
+bool Filter::test_event(const EventType &doc) const {
+    if (since.has_value() && doc.created_at < *since) return false;
+    if (until.has_value() && doc.created_at > *until) return false;
+    return _compiled.get(*this).test(doc);
 }
 
 
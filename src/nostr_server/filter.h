@@ -8,9 +8,13 @@
 #ifndef SRC_NOSTR_SERVER_FILTER_H_
 #define SRC_NOSTR_SERVER_FILTER_H_
 #include "publisher.h"
+#include "flat_event.h"
+#include "event_view.h"
 
+#include <atomic>
 #include <ctime>
 #include <map>
+#include <memory>
 #include <optional>
 #include <string>
 #include <vector>
@@ -36,8 +40,49 @@ struct Filter {
     std::string ft_search;
 
     bool test(const Event &doc) const;
+    bool test(const FlatEvent &doc) const;
+    bool test(const EventView &doc) const;
     static Filter create(const JSON &f);
 
+    ///Rebuilds structures used by test()
+    /**
+     * The first test() compiles the filter: authors and ids are stored in
+     * sorted sets, kinds in a bitmap and tag values in sorted sets. A copy
+     * of the filter starts uncompiled, so it can be modified freely. If the
+     * filter itself is modified after it was tested, call this function
+     * (not concurrently with test())
+     */
+    void compile();
+
+protected:
+
+    class Compiled;
+
+    ///Compiled state of the filter, created by the first test()
+    /**
+     * The state is never copied nor moved with the filter, the target
+     * compiles own state from its fields
+     */
+    class CompiledHolder {
+    public:
+        CompiledHolder() = default;
+        CompiledHolder(const CompiledHolder &) {}
+        CompiledHolder &operator=(const CompiledHolder &);
+        ~CompiledHolder();
+
+        ///Retrieve compiled state, compile if needed (thread safe)
+        const Compiled &get(const Filter &f) const;
+        ///Discard compiled state
+        void reset();
+
+    protected:
+        mutable std::atomic<const Compiled *> _ptr = nullptr;
+    };
+
+    CompiledHolder _compiled;
+
+    template<typename EventType>
+    bool test_event(const EventType &doc) const;
 
 };
 
@@ -0,0 +1,182 @@
+/*
+ * flat_event.cpp
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#include "flat_event.h"
+
+#include <docdb/json.h>
+
+#include <algorithm>
+
+namespace nostr_server {
+
+static bool is_lower_hex(std::string_view str) {
+    return std::all_of(str.begin(), str.end(), [](char c){
+        return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+    });
+}
+
+static std::size_t flat_tag_hash(char t, std::string_view content) {
+    std::hash<std::string_view> hasher;
+    return hasher(content) * 31 + t;
+}
+
+FlatEvent::FlatEvent(const Event &ev)
+    :kind(ev.kind)
+    ,created_at(ev.created_at)
+    ,id(ev.id)
+    ,author(ev.author)
+    ,sig(ev.sig)
+    ,nip97(ev.nip97)
+    ,trusted(ev.trusted)
+    ,ref_level(ev.ref_level) {
+
+    std::size_t need = ev.content.size();
+    std::size_t strcount = 0;
+    for (const auto &t: ev.tags) {
+        need += t.tag.size() + t.content.size();
+        for (const auto &x: t.additional_content) need += x.size();
+        strcount += 2 + t.additional_content.size();
+    }
+    _buffer.reserve(need);
+    _strings.reserve(strcount);
+    _tags.reserve(ev.tags.size());
+    _content = add_string(ev.content);
+    for (const auto &t: ev.tags) {
+        TagRef tr{static_cast<std::uint32_t>(_strings.size()), static_cast<std::uint32_t>(2 + t.additional_content.size())};
+        _strings.push_back(add_string(t.tag));
+        _strings.push_back(add_value(t.tag, t.content));
+        for (const auto &x: t.additional_content) _strings.push_back(add_string(x));
+        _tags.push_back(tr);
+    }
+    build_hash_map();
+}
+
+FlatEvent::StrRef FlatEvent::add_string(std::string_view str) {
+    StrRef ref{static_cast<std::uint32_t>(_buffer.size()), static_cast<std::uint32_t>(str.size())};
+    _buffer.append(str);
+    return ref;
+}
+
+FlatEvent::StrRef FlatEvent::add_value(std::string_view tag, std::string_view str) {
+    StrRef ref = add_string(str);
+    if (tag == "p" || tag == "e") pack_value(ref);
+    return ref;
+}
+
+void FlatEvent::pack_value(StrRef &ref) {
+    std::string_view str = get_string(ref);
+    //only exact lowercase form can be restored
+    if (str.size() != 64 || ref.offset + ref.size != _buffer.size() || !is_lower_hex(str)) return;
+    Binary<32> bin = Binary<32>::from_hex(str);
+    _buffer.resize(ref.offset);
+    _buffer.append(reinterpret_cast<const char *>(bin.data()), bin.size());
+    ref.size = binary_value;
+}
+
+std::string_view FlatEvent::get_string(const StrRef &ref, HexBuffer &tmp) const {
+    if (ref.size != binary_value) return get_string(ref);
+    auto iter = _buffer.begin() + ref.offset;
+    binary_to_hex(iter, iter + 32, tmp.begin());
+    return std::string_view(tmp.data(), tmp.size());
+}
+
+void FlatEvent::build_hash_map() {
+    HexBuffer tmp;
+    _tag_hash_map.clear();
+    _tag_hash_map.resize(_tags.size()*2+1,0);
+    for (std::size_t i = 0; i < _tags.size(); ++i) {
+        std::string_view name = get_string(_strings[_tags[i].first]);
+        if (name.size() != 1) continue;
+        std::size_t idx = flat_tag_hash(name[0], tag_string(i, 1, tmp)) % _tag_hash_map.size();
+        while (_tag_hash_map[idx]) {
+            idx = (idx+1) % _tag_hash_map.size();
+        }
+        _tag_hash_map[idx] = static_cast<std::uint16_t>(i + 1);
+    }
+}
+
+bool FlatEvent::has_indexed_tag(char t, std::string_view content) const {
+    if (_tag_hash_map.empty()) return false;
+    HexBuffer tmp;
+    auto idx = flat_tag_hash(t,content) % _tag_hash_map.size();
+    while (_tag_hash_map[idx]) {
+        std::size_t f = _tag_hash_map[idx] - 1;
+        std::string_view name = get_string(_strings[_tags[f].first]);
+        if (name[0] == t && tag_string(f, 1, tmp) == content) return true;
+        idx = (idx+1) % _tag_hash_map.size();
+    }
+    return false;
+}
+
+std::string FlatEvent::get_tag_content(std::string_view tag) const {
+    HexBuffer tmp;
+    std::string_view r;
+    for (std::size_t i = 0; i < _tags.size(); ++i) {
+        if (get_string(_strings[_tags[i].first]) == tag) r = tag_string(i, 1, tmp);
+    }
+    return std::string(r);
+}
+
+Event FlatEvent::to_event() const {
+    HexBuffer tmp;
+    Event ev;
+    ev.kind = kind;
+    ev.created_at = created_at;
+    ev.id = id;
+    ev.author = author;
+    ev.sig = sig;
+    ev.nip97 = nip97;
+    ev.trusted = trusted;
+    ev.ref_level = ref_level;
+    ev.content = content();
+    ev.tags.reserve(_tags.size());
+    for (std::size_t i = 0; i < _tags.size(); ++i) {
+        Event::Tag t;
+        t.tag = tag_string(i, 0, tmp);
+        t.content = tag_string(i, 1, tmp);
+        for (std::size_t j = 2; j < _tags[i].count; ++j) {
+            t.additional_content.emplace_back(tag_string(i, j, tmp));
+        }
+        ev.tags.push_back(std::move(t));
+    }
+    ev.build_hash_map();
+    return ev;
+}
+
+docdb::Structured FlatEvent::toStructured() const {
+    Event::IDHex id_str = id;
+    Event::SignatureHex sig_str = sig;
+    Event::PubkeyHex pubkey_str = author;
+    HexBuffer tmp;
+    docdb::Structured::Array tags_arr;
+    tags_arr.reserve(_tags.size());
+    for (std::size_t i = 0; i < _tags.size(); ++i) {
+        docdb::Structured::Array row;
+        row.reserve(_tags[i].count);
+        for (std::size_t j = 0; j < _tags[i].count; ++j) {
+            const StrRef &ref = _strings[_tags[i].first+j];
+            if (ref.size == binary_value) {
+                row.push_back(std::string(get_string(ref, tmp)));
+            } else {
+                row.push_back(get_string(ref));
+            }
+        }
+        tags_arr.push_back(std::move(row));
+    }
+    docdb::Structured ev = {
+        {"content", content()},
+        {"id", std::string(id_str.data(), id_str.size())},
+        {"pubkey", std::string(pubkey_str.data(),pubkey_str.size())},
+        {"sig", std::string(sig_str.data(), sig_str.size())},
+        {"kind", kind},
+        {"created_at", created_at}
+    };
+    ev.set("tags", std::move(tags_arr));
+    return ev;
+}
+
+}
@@ -0,0 +1,221 @@
+/*
+ * flat_event.h
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_NOSTR_SERVER_FLAT_EVENT_H_
+#define SRC_NOSTR_SERVER_FLAT_EVENT_H_
+#include "event.h"
+
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace nostr_server {
+
+///Compact representation of the event
+/**
+ * All strings (content, tag names, values) are stored in one contiguous
+ * buffer. Tags are described by the offset table. Values of the 'p' and 'e'
+ * tags in the hex form are stored as 32 binary bytes. Decoding of the event
+ * with many tags takes only a few allocations, regardless on count of tags
+ *
+ * The object is read-only, it is created from the Event or decoded
+ * from the storage (FlatEventDocument)
+ */
+class FlatEvent {
+public:
+
+    ///Buffer used to render values stored in binary form
+    using HexBuffer = std::array<char, 64>;
+
+    Event::Kind kind = 0;
+    std::time_t created_at = 0;
+    Event::ID id;
+    Event::Pubkey author;
+    Event::Signature sig;
+    bool nip97 = false;
+    bool trusted = false;
+    Event::Depth ref_level = 0;
+
+    FlatEvent() = default;
+    explicit FlatEvent(const Event &ev);
+
+    ///Convert to Event
+    Event to_event() const;
+    docdb::Structured toStructured() const;
+
+    std::string_view content() const {return get_string(_content);}
+
+    ///Count of tags
+    std::size_t tag_count() const {return _tags.size();}
+    ///Count of strings of the tag (name, value, additional content)
+    std::size_t tag_size(std::size_t tag) const {return _tags[tag].count;}
+    ///Retrieve string of the tag
+    /**
+     * @param tag index of tag
+     * @param idx index of string, 0 - tag name, 1 - value, 2+ - additional content
+     * @param tmp buffer used to render value stored in binary form
+     * @return the string. The view can refer to the tmp buffer
+     */
+    std::string_view tag_string(std::size_t tag, std::size_t idx, HexBuffer &tmp) const {
+        return get_string(_strings[_tags[tag].first+idx], tmp);
+    }
+    std::string get_tag_content(std::string_view tag) const;
+
+    ///Search tag by name and value (same as Event::find_indexed_tag)
+    bool has_indexed_tag(char t, std::string_view content) const;
+
+    ///Decode from the serialized form (see EventDocument)
+    template<typename Iter>
+    static FlatEvent from_binary(unsigned char content_extra, Iter &at, Iter end);
+
+protected:
+
+    static constexpr std::uint32_t binary_value = static_cast<std::uint32_t>(-1);
+
+    struct StrRef {
+        std::uint32_t offset;
+        ///size of the string, binary_value for value stored as 32 bytes
+        std::uint32_t size;
+    };
+    struct TagRef {
+        std::uint32_t first;
+        std::uint32_t count;
+    };
+
+    std::string _buffer;
+    StrRef _content = {0,0};
+    std::vector<StrRef> _strings;
+    std::vector<TagRef> _tags;
+    std::vector<std::uint16_t> _tag_hash_map;
+
+    std::string_view get_string(const StrRef &ref) const {
+        return std::string_view(_buffer).substr(ref.offset, ref.size);
+    }
+    std::string_view get_string(const StrRef &ref, HexBuffer &tmp) const;
+
+    StrRef add_string(std::string_view str);
+    ///adds tag value, hex values of p and e tags are stored binary
+    StrRef add_value(std::string_view tag, std::string_view str);
+    ///converts the string at the end of the buffer to binary form, if it is lowercase hex of 32 bytes
+    void pack_value(StrRef &ref);
+    void build_hash_map();
+
+    template<typename Iter>
+    StrRef read_string(unsigned char extra, Iter &at, Iter end);
+};
+
+using FlatEventOrAttachment = std::variant<FlatEvent, Attachment>;
+
+///Document definition which decodes stored events into FlatEvent
+/**
+ * Binary format is the same as the EventDocument, so the same collection
+ * can be opened through both definitions
+ */
+struct FlatEventDocument {
+    using Srl = docdb::StructuredDocument<>;
+    using Type = FlatEventOrAttachment;
+
+    template<typename Iter>
+    static Iter to_binary(const FlatEventOrAttachment &evatt, Iter out) {
+        if (std::holds_alternative<FlatEvent>(evatt)) {
+            return EventDocument::to_binary(EventOrAttachment(std::get<FlatEvent>(evatt).to_event()), out);
+        } else {
+            return EventDocument::to_binary(EventOrAttachment(std::get<Attachment>(evatt)), out);
+        }
+    }
+    template<typename Iter>
+    static FlatEventOrAttachment from_binary(Iter &at, Iter end) {
+        unsigned char ex = get_extra(at,end);
+        if (ex == 1) {
+            FlatEventOrAttachment out{Attachment{}};
+            Attachment &att  = std::get<Attachment>(out);
+            for (std::size_t i = 0; i < att.id.size() && at != end; i++) {
+                att.id[i] = *at++;
+            }
+            att.data.assign(at, end);
+            at = end;
+            return out;
+        }
+        unsigned char x = get_extra(at,end);
+        return FlatEvent::from_binary(x, at, end);
+    }
+    template<typename Iter>
+    static unsigned char get_extra(Iter &at, Iter end) {
+        return EventDocument::get_extra(at, end);
+    }
+};
+
+template<typename Iter>
+inline FlatEvent::StrRef FlatEvent::read_string(unsigned char extra, Iter &at, Iter end) {
+    //string is serialized as its length followed by the bytes
+    std::size_t len = FlatEventDocument::Srl::uint_from_binary(extra, at, end);
+    StrRef ref{static_cast<std::uint32_t>(_buffer.size()), 0};
+    while (len && at != end) {
+        _buffer.push_back(static_cast<char>(*at));
+        ++at;
+        --len;
+    }
+    ref.size = static_cast<std::uint32_t>(_buffer.size() - ref.offset);
+    return ref;
+}
+
+template<typename Iter>
+inline FlatEvent FlatEvent::from_binary(unsigned char x, Iter &at, Iter end) {
+    using Srl = FlatEventDocument::Srl;
+    auto get_extra = [](Iter &at, Iter end) {return EventDocument::get_extra(at, end);};
+    FlatEvent ev;
+    if constexpr(std::is_base_of_v<std::random_access_iterator_tag, typename std::iterator_traits<Iter>::iterator_category>) {
+        //strings can't be longer than the serialized form
+        ev._buffer.reserve(std::distance(at, end));
+    }
+    ev.nip97 = (x & 0x80) != 0;
+    ev.trusted = (x & 0x40) != 0;
+    ev._content = ev.read_string(x, at, end);
+    x = get_extra(at,end);
+    ev.kind = Srl::uint_from_binary(x,at,end);
+    x = get_extra(at,end);
+    ev.created_at = Srl::uint_from_binary(x,at,end);
+    x = get_extra(at,end);
+    std::size_t tag_count = Srl::uint_from_binary(x,at,end);
+    ev._tags.reserve(tag_count);
+    ev._strings.reserve(tag_count * 2);
+    for (std::size_t i = 0; i < tag_count; ++i) {
+        TagRef tr{static_cast<std::uint32_t>(ev._strings.size()), 2};
+        x = get_extra(at,end);
+        StrRef name = ev.read_string(x, at, end);
+        ev._strings.push_back(name);
+        x = get_extra(at,end);
+        StrRef value = ev.read_string(x, at, end);
+        std::string_view name_str = ev.get_string(name);
+        if (name_str == "p" || name_str == "e") ev.pack_value(value);
+        ev._strings.push_back(value);
+        x = get_extra(at,end);
+        std::size_t add_count = Srl::uint_from_binary(x,at,end);
+        for (std::size_t j = 0; j < add_count; ++j)  {
+            x = get_extra(at,end);
+            ev._strings.push_back(ev.read_string(x, at, end));
+        }
+        tr.count += add_count;
+        ev._tags.push_back(tr);
+    }
+    EventDocument::load_bin(at, end, ev.id);
+    EventDocument::load_bin(at, end, ev.author);
+    EventDocument::load_bin(at, end, ev.sig);
+    ev.ref_level = get_extra(at, end);
+    ev.build_hash_map();
+    return ev;
+}
+
+
+}
+
+
+
+#endif /* SRC_NOSTR_SERVER_FLAT_EVENT_H_ */
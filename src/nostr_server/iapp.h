@@ -3,6 +3,9 @@
 #define SRC_NOSTR_SERVER_IAPP_H_
 #include "publisher.h"
 #include "filter.h"
+#include "subscription_index.h"
+#include "signature_verifier.h"
+#include "event_cache.h"
 
 
 
@@ -12,6 +15,7 @@
 #include <docdb/indexer.h>
 #include <docdb/binops.h>
 
+#include <functional>
 #include <optional>
 
 namespace nostr_server {
@@ -34,6 +38,10 @@ public:
     using IdHashKey = std::size_t;
 
     using Storage = docdb::Storage<EventDocument>;
+    ///Read-only view to the storage, which decodes events into FlatEvent
+    using FlatStorage = docdb::StorageView<FlatEventDocument>;
+    ///Read-only view to the storage, which provides undecoded events
+    using EventViewStorage = docdb::StorageView<EventViewDocument>;
     using IndexViewByAuthorKindTag = docdb::IndexView<Storage,TimestampRowDef, docdb::IndexType::unique>;
 
     using OrderingItem = std::pair<unsigned int, unsigned int>;
@@ -41,9 +49,28 @@ public:
 
     using DocIDList = std::vector<docdb::DocID>;
 
+    ///Result of COUNT
+    struct CountResult {
+        std::size_t count = 0;
+        ///count is estimated (NIP-45 approximate)
+        bool approximate = false;
+    };
+
     virtual ~IApp() = default;
     virtual EventPublisher &get_publisher() = 0;
+    ///Retrieves index of active subscriptions of all peers
+    virtual SubscriptionIndex &get_subscriptions() = 0;
     virtual Storage &get_storage() = 0;
+    virtual const FlatStorage &get_flat_storage() const = 0;
+    virtual const EventViewStorage &get_view_storage() const = 0;
+    ///Retrieves stored event through the shared cache
+    /**
+     * @param id document id
+     * @return the event (or attachment, see EventView::is_event()), nullptr if not found
+     */
+    virtual EventCache::PEvent find_event(docdb::DocID id) const = 0;
+    ///Retrieves shared service for verification of signatures
+    virtual SignatureVerifier &get_verifier() = 0;
     ///Returns candidates for given filter
     /**
      * @note doesn't apply filter!, it just chooses index to enumerate documents,
@@ -52,6 +79,36 @@ public:
      * @return candidates
      */
     virtual void find_in_index(RecordSetCalculator &calc, const std::vector<Filter> &filters) const = 0;
+    ///Finds newest events matching the filters
+    /**
+     * Walks time ordered indexes from the newest to the oldest event and
+     * stops once the limit is reached. Constraints of the filter are
+     * joined lazily (leapfrog join), no candidate set is materialized.
+     * Unlike find_in_index, the filter is applied, so the result contains
+     * only matching events. Results are shared by all peers through
+     * the result cache
+     *
+     * @param filters filters
+     * @param limit maximum count of events, -1 for no limit
+     * @param result ordered list of events (newest first)
+     * @retval true done
+     * @retval false filters cannot be processed this way (ids, fulltext search,
+     *  unconstrained filter without limit), use find_in_index
+     */
+    virtual bool find_newest(const std::vector<Filter> &filters, std::size_t limit, DocIDList &result) const = 0;
+    ///Executes the query in the query pool
+    /**
+     * Independent filters are executed in parallel
+     *
+     * @param filters filters
+     * @param limit maximum count of events, use -1 for no limit
+     * @return ordered list of candidates (best first). If the query was
+     * processed by find_newest, filters are already applied. Otherwise, the
+     * result contains candidates which still need to be tested
+     */
+    virtual cocls::future<DocIDList> query(std::vector<Filter> filters, std::size_t limit) = 0;
+    ///Counts candidates in the query pool (for COUNT command)
+    virtual cocls::future<CountResult> count(std::vector<Filter> filters) = 0;
     virtual docdb::DocID find_event_by_id(const Event::ID &id) const = 0;
     virtual docdb::DocID doc_to_replace(const Event &event) const = 0;
     virtual docdb::DocID find_replacable(std::string_view pubkey, unsigned int kind, std::string_view category) const = 0;
@@ -61,6 +118,32 @@ public:
     virtual void client_counter(int increment, std::string_view url) = 0;
     virtual void publish(Event &&ev, const void *publisher) = 0;
     virtual void publish(Event &&ev, const Attachment &attach, const void *publisher) = 0;
+    ///Sends event to live subscriptions without storing it
+    /**
+     * Used for ephemeral events and for events already stored by the caller
+     */
+    virtual void broadcast(Event &&ev, const void *publisher) = 0;
+    ///Removes stored document without broadcasting
+    /**
+     * Cached results and recent events are updated
+     */
+    virtual void erase_event(docdb::DocID id) = 0;
+    ///Commits changes of the storage made by the function
+    /**
+     * @param build function which writes to the batch. If it throws, nothing
+     * is committed
+     *
+     * Recent events, cached results and other in-memory state are updated
+     * after commit. Always use this function instead of direct commit
+     */
+    virtual void commit(const std::function<void(docdb::Batch &)> &build) = 0;
+    ///Stores and publishes the event using group commit
+    /**
+     * @return future resolved after the event is committed. Rejected
+     * with docdb::DuplicateKeyException for duplicate events. Outdated
+     * replaceable event is silently ignored
+     */
+    virtual cocls::future<void> write_event(Event &&ev, const void *publisher) = 0;
     virtual bool check_whitelist(const Event::Pubkey &k) const = 0;
     virtual int get_karma(const Event::Pubkey &k) const = 0;
     virtual bool is_this_me(std::string_view relay) const = 0;
@@ -0,0 +1,188 @@
+/*
+ * id_filter.cpp
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#include "id_filter.h"
+
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <utility>
+
+namespace nostr_server {
+
+IdFilter::IdFilter() {
+    std::random_device rnd;
+    for (auto &k: _key) {
+        k = (static_cast<std::uint64_t>(rnd()) << 32) | rnd();
+    }
+}
+
+void IdFilter::reset(std::size_t capacity) {
+    std::unique_lock _(_mx);
+    _slots.clear();
+    _removed.clear();
+    _count = 0;
+    _mask = 0;
+    _capacity = 0;
+    _ready = false;
+    _overflow = false;
+    //the filter stays enabled during rebuild, otherwise changes made during reset would not be reported
+    if (!capacity) {
+        _enabled = false;
+        return;
+    }
+    //count of buckets is power of 2, load factor is kept below 50%
+    std::size_t buckets = 1;
+    while (buckets * bucket_size < capacity * 2) buckets <<= 1;
+    _slots.resize(buckets * bucket_size, 0);
+    _mask = buckets - 1;
+    _capacity = capacity;
+    _enabled = true;
+}
+
+void IdFilter::set_ready() {
+    std::unique_lock _(_mx);
+    //ids removed before the scan reached them were skipped, others keep
+    //their fingerprint, which only causes a false 'maybe'
+    _removed.clear();
+    _ready = _enabled && !_overflow;
+}
+
+static std::uint64_t mix(std::uint64_t x) {
+    //finalizer of splitmix64
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+std::uint64_t IdFilter::hash(const Event::ID &id) const {
+    std::uint64_t a, b;
+    std::memcpy(&a, id.data(), sizeof(a));
+    std::memcpy(&b, id.data() + sizeof(a), sizeof(b));
+    return mix(mix(a ^ _key[0]) + b + _key[1]);
+}
+
+IdFilter::Fingerprint IdFilter::fingerprint(std::uint64_t h) {
+    auto fp = static_cast<Fingerprint>(h >> 48);
+    //zero marks empty slot
+    return fp?fp:1;
+}
+
+std::size_t IdFilter::index(std::uint64_t h) const {
+    return static_cast<std::size_t>(h) & _mask;
+}
+
+std::size_t IdFilter::alt_index(std::size_t index, Fingerprint fp) const {
+    //partial-key cuckoo hashing, alt_index(alt_index(i)) == i
+    return (index ^ (static_cast<std::size_t>(fp) * 0x5bd1e995)) & _mask;
+}
+
+bool IdFilter::contains(std::size_t index, Fingerprint fp) const {
+    const Fingerprint *b = _slots.data() + index * bucket_size;
+    for (std::size_t i = 0; i < bucket_size; ++i) {
+        if (b[i] == fp) return true;
+    }
+    return false;
+}
+
+bool IdFilter::insert(std::size_t index, Fingerprint fp) {
+    Fingerprint *b = _slots.data() + index * bucket_size;
+    for (std::size_t i = 0; i < bucket_size; ++i) {
+        if (!b[i]) {
+            b[i] = fp;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool IdFilter::erase(std::size_t index, Fingerprint fp) {
+    Fingerprint *b = _slots.data() + index * bucket_size;
+    for (std::size_t i = 0; i < bucket_size; ++i) {
+        if (b[i] == fp) {
+            b[i] = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+void IdFilter::load(const Event::ID &id) {
+    if (!_enabled) return;
+    std::uint64_t h = hash(id);
+    std::unique_lock _(_mx);
+    if (!_enabled) return;
+    //removed after the reset, if it was stored again, it was added by add()
+    if (_removed.erase(h)) return;
+    add(h);
+}
+
+void IdFilter::add(const Event::ID &id) {
+    if (!_enabled) return;
+    std::uint64_t h = hash(id);
+    std::unique_lock _(_mx);
+    if (!_enabled) return;
+    add(h);
+}
+
+void IdFilter::add(std::uint64_t h) {
+    Fingerprint fp = fingerprint(h);
+    std::size_t i1 = index(h);
+    std::size_t i2 = alt_index(i1, fp);
+    if (insert(i1, fp) || insert(i2, fp)) {
+        ++_count;
+        return;
+    }
+    //relocate random fingerprints to their alternate buckets
+    std::size_t i = i1;
+    for (unsigned int n = 0; n < max_kicks; ++n) {
+        _rnd ^= _rnd << 13;
+        _rnd ^= _rnd >> 17;
+        _rnd ^= _rnd << 5;
+        std::swap(fp, _slots[i * bucket_size + _rnd % bucket_size]);
+        i = alt_index(i, fp);
+        if (insert(i, fp)) {
+            ++_count;
+            return;
+        }
+    }
+    //a fingerprint was lost, the filter can't answer 'no' until it is rebuilt
+    _ready = false;
+    _overflow = true;
+}
+
+void IdFilter::remove(const Event::ID &id) {
+    if (!_enabled) return;
+    std::uint64_t h = hash(id);
+    Fingerprint fp = fingerprint(h);
+    std::unique_lock _(_mx);
+    if (!_enabled) return;
+    //during the load the fingerprint can belong to other id not loaded yet
+    if (!_ready && !_overflow) {
+        _removed.insert(h);
+        return;
+    }
+    std::size_t i1 = index(h);
+    if (erase(i1, fp) || erase(alt_index(i1, fp), fp)) --_count;
+}
+
+bool IdFilter::may_contain(const Event::ID &id) const {
+    if (!_ready) return true;
+    std::uint64_t h = hash(id);
+    Fingerprint fp = fingerprint(h);
+    std::shared_lock _(_mx);
+    if (!_ready) return true;
+    std::size_t i1 = index(h);
+    if (contains(i1, fp) || contains(alt_index(i1, fp), fp)) return true;
+    ++_skipped;
+    return false;
+}
+
+}
@@ -0,0 +1,118 @@
+/*
+ * id_filter.h
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_NOSTR_SERVER_ID_FILTER_H_
+#define SRC_NOSTR_SERVER_ID_FILTER_H_
+#include "event.h"
+
+#include <atomic>
+#include <cstdint>
+#include <shared_mutex>
+#include <unordered_set>
+#include <vector>
+
+namespace nostr_server {
+
+///Cuckoo filter of ids of stored events
+/**
+ * Answers whether the event can be stored without reading the database. The
+ * answer 'no' is definitive, the answer 'maybe' must be confirmed by the index.
+ * Unlike Bloom filter, ids can be removed.
+ *
+ * Buckets have 4 slots with 16-bit fingerprints. The id is chosen by the
+ * author, so it is hashed with a random per-process key, otherwise crafted
+ * ids could overload few buckets.
+ *
+ * When the filter becomes full, it always answers 'maybe' until it is
+ * rebuilt with larger capacity (see is_overflow()). During the rebuild,
+ * ids are still added, but no fingerprint is erased, because the erased
+ * fingerprint could belong to other id, which was not loaded yet. Removed
+ * ids are remembered and they are skipped when the load reaches them.
+ */
+class IdFilter {
+public:
+
+    ///Construct disabled filter
+    IdFilter();
+
+    ///Clears the filter and allocates space
+    /**
+     * @param capacity expected maximum count of ids. If zero is passed,
+     * the filter is disabled
+     *
+     * The filter answers 'maybe' until set_ready() is called, but it
+     * accepts ids, so it can be filled while the storage is being changed
+     */
+    void reset(std::size_t capacity);
+    ///All stored ids were loaded, the filter can answer 'no'
+    void set_ready();
+
+    ///returns true, if the filter is maintained (changes must be reported)
+    bool is_enabled() const {return _enabled;}
+    ///returns true, if a fingerprint was lost, the filter must be rebuilt
+    bool is_overflow() const {return _overflow;}
+    ///current capacity
+    std::size_t get_capacity() const {return _capacity;}
+
+    ///Add id found by the scan of the storage during the load
+    /**
+     * Unlike add(), the id is skipped, if it was removed after reset()
+     */
+    void load(const Event::ID &id);
+    ///Add id of stored event
+    void add(const Event::ID &id);
+    ///Remove id of removed event (the id must be added before)
+    void remove(const Event::ID &id);
+    ///Test the id
+    /**
+     * @retval false the id is not stored
+     * @retval true the id can be stored (or the filter is disabled)
+     */
+    bool may_contain(const Event::ID &id) const;
+
+    ///count of ids in the filter
+    std::size_t get_count() const {return _count;}
+    ///count of lookups answered without reading the database
+    std::size_t get_skipped() const {return _skipped;}
+
+protected:
+
+    using Fingerprint = std::uint16_t;
+    static constexpr std::size_t bucket_size = 4;
+    ///maximum count of relocations during insert
+    static constexpr unsigned int max_kicks = 500;
+
+    std::vector<Fingerprint> _slots;
+    std::size_t _mask = 0;
+    std::size_t _capacity = 0;
+    std::uint32_t _rnd = 0x9E3779B9;
+    ///key of the hash function
+    std::uint64_t _key[2];
+    std::atomic<bool> _enabled = false;
+    std::atomic<bool> _ready = false;
+    std::atomic<bool> _overflow = false;
+    std::atomic<std::size_t> _count = 0;
+    mutable std::atomic<std::size_t> _skipped = 0;
+    mutable std::shared_mutex _mx;
+    ///hashes of ids removed during the load
+    std::unordered_set<std::uint64_t> _removed;
+
+    std::uint64_t hash(const Event::ID &id) const;
+    static Fingerprint fingerprint(std::uint64_t h);
+    std::size_t index(std::uint64_t h) const;
+    std::size_t alt_index(std::size_t index, Fingerprint fp) const;
+    bool contains(std::size_t index, Fingerprint fp) const;
+    bool insert(std::size_t index, Fingerprint fp);
+    bool erase(std::size_t index, Fingerprint fp);
+    void add(std::uint64_t h);
+};
+
+}
+
+
+
+#endif /* SRC_NOSTR_SERVER_ID_FILTER_H_ */
@@ -0,0 +1,108 @@
+/*
+ * karma_table.cpp
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#include "karma_table.h"
+
+#include <cstring>
+#include <random>
+
+namespace nostr_server {
+
+KarmaTable::KarmaTable() {
+    std::random_device rnd;
+    for (auto &k: _key) {
+        k = (static_cast<std::uint64_t>(rnd()) << 32) | rnd();
+    }
+    _tables.push_back(std::make_unique<Table>(1024));
+    _table.store(_tables.back().get(), std::memory_order_release);
+}
+
+static std::uint64_t mix(std::uint64_t x) {
+    //finalizer of splitmix64
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+std::size_t KarmaTable::hash(const Event::Pubkey &pk) const {
+    std::uint64_t a, b;
+    std::memcpy(&a, pk.data(), sizeof(a));
+    std::memcpy(&b, pk.data() + sizeof(a), sizeof(b));
+    return static_cast<std::size_t>(mix(mix(a ^ _key[0]) + b + _key[1]));
+}
+
+std::uint64_t KarmaTable::encode(const std::optional<Value> &val) {
+    if (!val) return used_bit;
+    return used_bit | present_bit | (val->local?local_bit:0)
+            | static_cast<std::uint32_t>(val->score);
+}
+
+std::optional<KarmaTable::Value> KarmaTable::find(const Event::Pubkey &pk) const {
+    const Table *t = _table.load(std::memory_order_acquire);
+    for (std::size_t i = hash(pk) & t->mask;; i = (i + 1) & t->mask) {
+        const Slot &s = t->slots[i];
+        std::uint64_t d = s.data.load(std::memory_order_acquire);
+        if (!d) return std::nullopt;
+        if (s.key == pk) {
+            if (!(d & present_bit)) return std::nullopt;
+            return Value{static_cast<int>(static_cast<std::uint32_t>(d)), (d & local_bit) != 0};
+        }
+    }
+}
+
+void KarmaTable::set(const Event::Pubkey &pk, const std::optional<Value> &val) {
+    std::lock_guard _(_mx);
+    store(pk, val);
+}
+
+void KarmaTable::store(const Event::Pubkey &pk, const std::optional<Value> &val) {
+    Table *t = _tables.back().get();
+    std::uint64_t d = encode(val);
+    for (std::size_t i = hash(pk) & t->mask;; i = (i + 1) & t->mask) {
+        Slot &s = t->slots[i];
+        std::uint64_t old = s.data.load(std::memory_order_relaxed);
+        if (!old) {
+            //missing row doesn't need a slot
+            if (!val) return;
+            //key is written before the slot becomes visible to readers
+            s.key = pk;
+            s.data.store(d, std::memory_order_release);
+            ++_count;
+            if (++t->used * 2 > t->mask + 1) grow();
+            return;
+        }
+        if (s.key == pk) {
+            s.data.store(d, std::memory_order_release);
+            if ((old & present_bit) && !val) --_count;
+            else if (!(old & present_bit) && val) ++_count;
+            return;
+        }
+    }
+}
+
+void KarmaTable::grow() {
+    const Table *t = _tables.back().get();
+    auto nt = std::make_unique<Table>((t->mask + 1) * 2);
+    for (std::size_t i = 0; i <= t->mask; ++i) {
+        const Slot &s = t->slots[i];
+        std::uint64_t d = s.data.load(std::memory_order_relaxed);
+        if (!d) continue;
+        std::size_t j = hash(s.key) & nt->mask;
+        while (nt->slots[j].data.load(std::memory_order_relaxed)) j = (j + 1) & nt->mask;
+        nt->slots[j].key = s.key;
+        nt->slots[j].data.store(d, std::memory_order_relaxed);
+        ++nt->used;
+    }
+    //readers of the old table see valid but possibly outdated values
+    _table.store(nt.get(), std::memory_order_release);
+    _tables.push_back(std::move(nt));
+}
+
+}
@@ -0,0 +1,112 @@
+/*
+ * karma_table.h
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_NOSTR_SERVER_KARMA_TABLE_H_
+#define SRC_NOSTR_SERVER_KARMA_TABLE_H_
+#include "event.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace nostr_server {
+
+///In-memory copy of the karma index (pubkey -> score and local flag)
+/**
+ * Readers don't lock, they can run in any thread. Writers are serialized
+ * by a mutex.
+ *
+ * The table uses open addressing with linear probing. The pubkey is
+ * chosen by the author, so it is hashed with a random per-process key,
+ * otherwise crafted pubkeys could build a long cluster. Keys are never
+ * removed (removed row is marked as missing). When the table grows, the
+ * old table is kept until the object is destroyed, because a reader
+ * can still use it. Total size of the retired tables is less than
+ * size of the current table.
+ */
+class KarmaTable {
+public:
+
+    struct Value {
+        int score = 0;
+        bool local = false;
+    };
+
+    KarmaTable();
+
+    ///Find the pubkey (lock-free)
+    /**
+     * @param pk pubkey
+     * @return value, or no value if the pubkey has no row
+     */
+    std::optional<Value> find(const Event::Pubkey &pk) const;
+
+    ///Set the value
+    /**
+     * @param pk pubkey
+     * @param val value, no value if the row doesn't exist
+     */
+    void set(const Event::Pubkey &pk, const std::optional<Value> &val);
+
+    ///Reload the value
+    /**
+     * @param pk pubkey
+     * @param load function which returns current value (std::optional<Value>).
+     * It is called under the lock, so the newest loaded value is always stored
+     */
+    template<typename Fn>
+    void reload(const Event::Pubkey &pk, Fn &&load) {
+        std::lock_guard _(_mx);
+        store(pk, load());
+    }
+
+    ///returns true, if there is no row
+    bool empty() const {return _count == 0;}
+    ///count of rows
+    std::size_t size() const {return _count;}
+
+protected:
+
+    static constexpr std::uint64_t used_bit = std::uint64_t(1) << 63;
+    static constexpr std::uint64_t present_bit = std::uint64_t(1) << 62;
+    static constexpr std::uint64_t local_bit = std::uint64_t(1) << 32;
+
+    struct Slot {
+        ///key is valid when data are not zero
+        Event::Pubkey key;
+        std::atomic<std::uint64_t> data = 0;
+    };
+
+    struct Table {
+        std::size_t mask;
+        std::unique_ptr<Slot[]> slots;
+        std::size_t used = 0;
+        explicit Table(std::size_t size):mask(size-1),slots(new Slot[size]) {}
+    };
+
+    std::atomic<const Table *> _table;
+    ///all allocated tables, the last one is current
+    std::vector<std::unique_ptr<Table> > _tables;
+    std::atomic<std::size_t> _count = 0;
+    std::mutex _mx;
+    ///key of the hash function
+    std::uint64_t _key[2];
+
+    std::size_t hash(const Event::Pubkey &pk) const;
+    static std::uint64_t encode(const std::optional<Value> &val);
+    void store(const Event::Pubkey &pk, const std::optional<Value> &val);
+    void grow();
+};
+
+}
+
+
+
+#endif /* SRC_NOSTR_SERVER_KARMA_TABLE_H_ */
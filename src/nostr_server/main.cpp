@@ -50,6 +50,20 @@ void read_leveldb_options(const ondra_shared::IniConfig::Section &ini, leveldb::
     opts.max_open_files = ini["max_open_files"].getUInt(1000);
 }
 
+static std::vector<unsigned int> parse_kinds(std::string_view list) {
+    std::vector<unsigned int> out;
+    while (!list.empty()) {
+        auto sep = list.find(',');
+        auto item = list.substr(0, sep);
+        list = sep == list.npos?std::string_view():list.substr(sep+1);
+        std::string s(item);
+        char *end;
+        auto k = std::strtoul(s.c_str(), &end, 10);
+        if (end != s.c_str()) out.push_back(static_cast<unsigned int>(k));
+    }
+    return out;
+}
+
 
 nostr_server::Config init_cfg(int argc, char **argv) {
     auto defcfg = getDefaultConfigPath(argv[0]);
@@ -77,6 +91,7 @@ nostr_server::Config init_cfg(int argc, char **argv) {
     auto metrics = cfg["metrics"];
     auto relaybot = cfg["relaybot"];
     auto log = cfg["log"];
+    auto query = cfg["query"];
 
     auto log_level = log["level"].getString("progress");
     auto log_file = log["file"].getPath();
@@ -96,12 +111,27 @@ nostr_server::Config init_cfg(int argc, char **argv) {
     nostr_server::Config outcfg;
     outcfg.listen_addr = main["listen"].getString("localhost:10000");
     outcfg.threads = main["threads"].getUInt(4);
+    outcfg.query_threads = query["threads"].getUInt(2);
+    outcfg.query_explain = query["explain"].getBool(false);
+    //fractional percentage is allowed (0.5)
+    outcfg.count_max_error = std::strtod(std::string(query["approximate_count_error_pct"].getString("0")).c_str(), nullptr)/100.0;
+    outcfg.result_cache_size = query["result_cache_mb"].getUInt(8)*1024*1024;
+    outcfg.recent_kinds = parse_kinds(query["recent_kinds"].getString("1,6,7"));
+    outcfg.recent_count = query["recent_count"].getUInt(2000);
+    outcfg.recent_max_age = query["recent_max_age_min"].getUInt(1440)*60;
+    outcfg.verify_threads = main["verify_threads"].getUInt(2);
     auto doc_root_path = cfgpath.parent_path() / "www";
     auto db_root_path = cfgpath.parent_path() / "data";
     outcfg.web_document_root = main["web_document_root"].getPath(doc_root_path);
 
     outcfg.database_path = db["path"].getPath(db_root_path);
     read_leveldb_options(db,outcfg.leveldb_options);
+    outcfg.store_json = db["store_json"].getBool(false);
+    outcfg.migrate_json = db["migrate_json"].getBool(false);
+    outcfg.event_cache_size = db["event_cache_mb"].getUInt(16)*1024*1024;
+    outcfg.id_filter = db["id_filter"].getBool(true);
+    outcfg.write_batch = db["write_batch"].getUInt(256);
+    outcfg.write_latency_us = db["write_latency_us"].getUInt(1000);
 
     std::string cert_chain = ssl["cert_chain_file"].getPath();
     std::string priv_key = ssl["priv_key_file"].getPath();
@@ -127,6 +157,7 @@ nostr_server::Config init_cfg(int argc, char **argv) {
     outcfg.options.read_only= options["read_only"].getBool(false);
     outcfg.options.attachment_max_size = options["max_file_size_kb"].getUInt(1024)*1024;
     outcfg.options.max_message_size = options["max_message_size_kb"].getUInt(64)*1024;
+    outcfg.options.replay_buffer_size = options["replay_buffer_kb"].getUInt(256)*1024;
 
     outcfg.private_key = replication["private_key"].getString("replicator_01");
 
@@ -0,0 +1,372 @@
+/*
+ * message_parser.cpp
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#include "message_parser.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace nostr_server {
+
+void MessageParser::Reader::skip_ws() {
+    while (_pos != _end && (*_pos == ' ' || *_pos == '\t' || *_pos == '\n' || *_pos == '\r')) ++_pos;
+}
+
+bool MessageParser::Reader::expect(char c) {
+    skip_ws();
+    if (_pos == _end || *_pos != c) return false;
+    ++_pos;
+    return true;
+}
+
+char MessageParser::Reader::peek() {
+    skip_ws();
+    return _pos == _end?0:*_pos;
+}
+
+bool MessageParser::Reader::at_end() {
+    skip_ws();
+    return _pos == _end;
+}
+
+bool MessageParser::Reader::read_plain_string(std::string_view &out) {
+    if (!expect('"')) return false;
+    const char *beg = _pos;
+    while (_pos != _end) {
+        char c = *_pos;
+        if (c == '"') {
+            out = std::string_view(beg, _pos - beg);
+            ++_pos;
+            return true;
+        }
+        if (c == '\\' || static_cast<unsigned char>(c) < 0x20) return false;
+        ++_pos;
+    }
+    return false;
+}
+
+bool MessageParser::Reader::read_hex4(unsigned int &cp) {
+    if (_end - _pos < 4) return false;
+    cp = 0;
+    for (int i = 0; i < 4; ++i) {
+        char c = *_pos++;
+        cp <<= 4;
+        if (c >= '0' && c <= '9') cp |= c - '0';
+        else if (c >= 'a' && c <= 'f') cp |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') cp |= c - 'A' + 10;
+        else return false;
+    }
+    return true;
+}
+
+void MessageParser::Reader::append_utf8(std::string &out, unsigned int cp) {
+    if (cp < 0x80) {
+        out.push_back(static_cast<char>(cp));
+    } else if (cp < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else {
+        out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+}
+
+bool MessageParser::Reader::read_string(std::string &out) {
+    if (!expect('"')) return false;
+    const char *beg = _pos;
+    while (_pos != _end) {
+        char c = *_pos;
+        if (c == '"') {
+            out.append(beg, _pos);
+            ++_pos;
+            return true;
+        }
+        if (static_cast<unsigned char>(c) < 0x20) return false;
+        if (c != '\\') {
+            ++_pos;
+            continue;
+        }
+        out.append(beg, _pos);
+        ++_pos;
+        if (_pos == _end) return false;
+        c = *_pos++;
+        switch (c) {
+            case '"':
+            case '\\':
+            case '/': out.push_back(c);break;
+            case 'b': out.push_back('\b');break;
+            case 'f': out.push_back('\f');break;
+            case 'n': out.push_back('\n');break;
+            case 'r': out.push_back('\r');break;
+            case 't': out.push_back('\t');break;
+            case 'u': {
+                unsigned int cp;
+                if (!read_hex4(cp)) return false;
+                if (cp >= 0xDC00 && cp < 0xE000) return false;
+                if (cp >= 0xD800 && cp < 0xDC00) {
+                    //surrogate pair
+                    unsigned int lo;
+                    if (_end - _pos < 2 || _pos[0] != '\\' || _pos[1] != 'u') return false;
+                    _pos += 2;
+                    if (!read_hex4(lo) || lo < 0xDC00 || lo >= 0xE000) return false;
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                }
+                append_utf8(out, cp);
+            } break;
+            default:
+                return false;
+        }
+        beg = _pos;
+    }
+    return false;
+}
+
+template<typename T>
+bool MessageParser::Reader::read_number(T &out) {
+    skip_ws();
+    if (_pos == _end || *_pos < '0' || *_pos > '9') return false;
+    T val = 0;
+    while (_pos != _end && *_pos >= '0' && *_pos <= '9') {
+        T d = *_pos - '0';
+        if (val > (std::numeric_limits<T>::max() - d) / 10) return false;
+        val = val * 10 + d;
+        ++_pos;
+    }
+    //floating numbers are left to the DOM parser
+    if (_pos != _end && (*_pos == '.' || *_pos == 'e' || *_pos == 'E')) return false;
+    out = val;
+    return true;
+}
+
+bool MessageParser::Reader::skip_value(int depth) {
+    if (depth > 32) return false;
+    char c = peek();
+    switch (c) {
+        case '"': {
+            std::string dummy;
+            return read_string(dummy);
+        }
+        case '[':
+        case '{': {
+            char close = c == '['?']':'}';
+            ++_pos;
+            if (expect(close)) return true;
+            do {
+                if (c == '{') {
+                    std::string dummy;
+                    if (!read_string(dummy) || !expect(':')) return false;
+                }
+                if (!skip_value(depth+1)) return false;
+            } while (expect(','));
+            return expect(close);
+        }
+        case 't': case 'f': case 'n': {
+            std::string_view rest(_pos, _end - _pos);
+            for (std::string_view lit: {"true","false","null"}) {
+                if (rest.substr(0, lit.size()) == lit) {
+                    _pos += lit.size();
+                    return true;
+                }
+            }
+            return false;
+        }
+        default: {
+            const char *beg = _pos;
+            while (_pos != _end && ((*_pos >= '0' && *_pos <= '9')
+                    || *_pos == '-' || *_pos == '+' || *_pos == '.' || *_pos == 'e' || *_pos == 'E')) ++_pos;
+            return _pos != beg;
+        }
+    }
+}
+
+template<typename Fn>
+bool MessageParser::read_array(Reader &rd, Fn &&fn) {
+    if (!rd.expect('[')) return false;
+    if (rd.expect(']')) return true;
+    do {
+        if (!fn()) return false;
+    } while (rd.expect(','));
+    return rd.expect(']');
+}
+
+bool MessageParser::parse_event_object(Reader &rd, Event &ev, std::string_view &id_text) {
+    enum Field {
+        f_id = 1, f_pubkey = 2, f_sig = 4, f_content = 8, f_created_at = 16, f_kind = 32, f_tags = 64
+    };
+    constexpr unsigned int required = f_id | f_pubkey | f_sig | f_content | f_created_at | f_kind;
+    unsigned int seen = 0;
+    auto mark = [&](unsigned int f) {
+        if (seen & f) return false;     //duplicate key
+        seen |= f;
+        return true;
+    };
+
+    if (!rd.expect('{')) return false;
+    if (!rd.expect('}')) {
+        do {
+            std::string_view key;
+            if (!rd.read_plain_string(key) || !rd.expect(':')) return false;
+            if (key == "id") {
+                if (!mark(f_id) || !rd.read_plain_string(id_text)) return false;
+                ev.id = Event::ID::from_hex(id_text);
+            } else if (key == "pubkey") {
+                std::string_view v;
+                if (!mark(f_pubkey) || !rd.read_plain_string(v)) return false;
+                ev.author = Event::Pubkey::from_hex(v);
+            } else if (key == "sig") {
+                std::string_view v;
+                if (!mark(f_sig) || !rd.read_plain_string(v)) return false;
+                ev.sig = Event::Signature::from_hex(v);
+            } else if (key == "content") {
+                if (!mark(f_content) || !rd.read_string(ev.content)) return false;
+            } else if (key == "created_at") {
+                if (!mark(f_created_at) || !rd.read_number(ev.created_at)) return false;
+            } else if (key == "kind") {
+                if (!mark(f_kind) || !rd.read_number(ev.kind)) return false;
+            } else if (key == "tags") {
+                if (!mark(f_tags)) return false;
+                bool ok = read_array(rd, [&]{
+                    Event::Tag t;
+                    std::size_t cnt = 0;
+                    bool ok = read_array(rd, [&]{
+                        switch (cnt++) {
+                            case 0: return rd.read_string(t.tag);
+                            case 1: return rd.read_string(t.content);
+                            default: return rd.read_string(t.additional_content.emplace_back());
+                        }
+                    });
+                    if (!ok || cnt < 2 || t.tag.empty()) return false;
+                    ev.tags.push_back(std::move(t));
+                    return true;
+                });
+                if (!ok) return false;
+            } else {
+                if (!rd.skip_value()) return false;
+            }
+        } while (rd.expect(','));
+        if (!rd.expect('}')) return false;
+    }
+    if ((seen & required) != required) return false;
+    //invalid event is reported by the DOM path
+    if (ev.calc_id() != ev.id) return false;
+    ev.build_hash_map();
+    return true;
+}
+
+bool MessageParser::parse_event(std::string_view text, Event &ev, std::string_view &id_text) {
+    Reader rd(text);
+    std::string_view cmd;
+    if (!rd.expect('[') || !rd.read_plain_string(cmd) || cmd != "EVENT" || !rd.expect(',')) return false;
+    Event tmp;
+    if (!parse_event_object(rd, tmp, id_text)) return false;
+    if (!rd.expect(']') || !rd.at_end()) return false;
+    ev = std::move(tmp);
+    return true;
+}
+
+bool MessageParser::peek_event_id(std::string_view text, Event::ID &id, std::string_view &id_text) {
+    Reader rd(text);
+    std::string_view cmd;
+    if (!rd.expect('[') || !rd.read_plain_string(cmd) || cmd != "EVENT" || !rd.expect(',')
+            || !rd.expect('{') || rd.expect('}')) return false;
+    do {
+        std::string_view key;
+        if (!rd.read_plain_string(key) || !rd.expect(':')) return false;
+        if (key == "id") {
+            if (!rd.read_plain_string(id_text) || id_text.size() != id.size() * 2) return false;
+            id = Event::ID::from_hex(id_text);
+            Event::IDHex hex = id;
+            return std::string_view(hex.data(), hex.size()) == id_text;
+        }
+        if (!rd.skip_value()) return false;
+    } while (rd.expect(','));
+    return false;
+}
+
+bool MessageParser::parse_filter_object(Reader &rd, Filter &out) {
+    std::vector<std::string_view> keys;
+    if (!rd.expect('{')) return false;
+    if (!rd.expect('}')) {
+        do {
+            std::string_view k;
+            if (!rd.read_plain_string(k) || !rd.expect(':')) return false;
+            if (std::find(keys.begin(), keys.end(), k) != keys.end()) return false;
+            keys.push_back(k);
+            bool ok;
+            if (k == "authors") {
+                ok = read_array(rd, [&]{
+                    std::string_view hx;
+                    if (!rd.read_plain_string(hx)) return false;
+                    auto pk = Event::Pubkey::from_hex(hx);
+                    out.authors.push_back({pk,std::min<unsigned char>(pk.size(),hx.size()/2)});
+                    return true;
+                });
+            } else if (k == "ids") {
+                ok = read_array(rd, [&]{
+                    std::string_view hx;
+                    if (!rd.read_plain_string(hx)) return false;
+                    auto id = Event::ID::from_hex(hx);
+                    out.ids.push_back({id,std::min<unsigned char>(id.size(),hx.size()/2)});
+                    return true;
+                });
+            } else if (k == "kinds") {
+                ok = read_array(rd, [&]{
+                    return rd.read_number(out.kinds.emplace_back());
+                });
+            } else if (k.substr(0,1) == "#") {
+                auto t = k.substr(1);
+                if (t.size() == 1) {
+                    out.tags.push_back({t[0],{}});
+                    auto &tt = out.tags.back().second;
+                    ok = read_array(rd, [&]{
+                        return rd.read_string(tt.emplace_back());
+                    });
+                } else {
+                    ok = rd.skip_value();
+                }
+            } else if (k == "since") {
+                ok = rd.read_number(out.since.emplace());
+            } else if (k == "until") {
+                ok = rd.read_number(out.until.emplace());
+            } else if (k == "limit") {
+                ok = rd.read_number(out.limit.emplace());
+            } else if (k == "search") {
+                ok = rd.read_string(out.ft_search);
+            } else {
+                ok = rd.skip_value();
+            }
+            if (!ok) return false;
+        } while (rd.expect(','));
+        if (!rd.expect('}')) return false;
+    }
+    std::sort(out.tags.begin(), out.tags.end());
+    return true;
+}
+
+bool MessageParser::parse_req(std::string_view text, std::string &sub_id, std::vector<Filter> &filters) {
+    Reader rd(text);
+    std::string_view cmd;
+    if (!rd.expect('[') || !rd.read_plain_string(cmd) || cmd != "REQ" || !rd.expect(',')) return false;
+    std::string id;
+    if (!rd.read_string(id)) return false;
+    std::vector<Filter> flts;
+    while (rd.expect(',')) {
+        if (!parse_filter_object(rd, flts.emplace_back())) return false;
+    }
+    if (!rd.expect(']') || !rd.at_end()) return false;
+    sub_id = std::move(id);
+    filters = std::move(flts);
+    return true;
+}
+
+}
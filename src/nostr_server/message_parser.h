@@ -0,0 +1,105 @@
+/*
+ * message_parser.h
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_NOSTR_SERVER_MESSAGE_PARSER_H_
+#define SRC_NOSTR_SERVER_MESSAGE_PARSER_H_
+#include "event.h"
+#include "filter.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace nostr_server {
+
+///Parses the most frequent client messages directly from the text
+/**
+ * EVENT and REQ messages are parsed without building the Structured DOM,
+ * the Event and Filter are filled directly. Parser handles only
+ * well formed messages of expected shape. If the message is unusual
+ * (unexpected types, duplicate keys, floating numbers, invalid event),
+ * the parser fails and the caller must use the DOM path, which also
+ * generates correct error messages.
+ */
+class MessageParser {
+public:
+
+    ///Parse ["EVENT", {...}]
+    /**
+     * @param text message text
+     * @param ev parsed event, id is validated
+     * @param id_text id of the event as it was in the message
+     * @retval true parsed
+     * @retval false use DOM path
+     */
+    static bool parse_event(std::string_view text, Event &ev, std::string_view &id_text);
+
+    ///Extract id of the event from ["EVENT", {...}] without parsing the event
+    /**
+     * Scans members of the event object until the "id" is found, other
+     * members are skipped. The rest of the message is not validated.
+     * Used to detect duplicates before the event is parsed and hashed
+     *
+     * @param text message text
+     * @param id id of the event
+     * @param id_text id of the event as it was in the message
+     * @retval true found, id is in canonical form (lowercase hex)
+     * @retval false not found
+     */
+    static bool peek_event_id(std::string_view text, Event::ID &id, std::string_view &id_text);
+
+    ///Parse ["REQ", "sub_id", {...}, ...]
+    /**
+     * @param text message text
+     * @param sub_id subscription id
+     * @param filters parsed filters
+     * @retval true parsed
+     * @retval false use DOM path
+     */
+    static bool parse_req(std::string_view text, std::string &sub_id, std::vector<Filter> &filters);
+
+protected:
+
+    class Reader {
+    public:
+        Reader(std::string_view text):_pos(text.data()),_end(text.data()+text.size()) {}
+
+        void skip_ws();
+        ///checks and skips the character
+        bool expect(char c);
+        ///next non-white character (not skipped)
+        char peek();
+        bool at_end();
+        ///reads string, unescaped content is appended to the output
+        bool read_string(std::string &out);
+        ///reads string which doesn't contain escape sequences (keys, hex values)
+        bool read_plain_string(std::string_view &out);
+        ///reads non-negative integer number
+        template<typename T>
+        bool read_number(T &out);
+        bool skip_value(int depth = 0);
+    protected:
+        static void append_utf8(std::string &out, unsigned int cp);
+        bool read_hex4(unsigned int &cp);
+
+        const char *_pos;
+        const char *_end;
+    };
+
+    static bool parse_event_object(Reader &rd, Event &ev, std::string_view &id_text);
+    static bool parse_filter_object(Reader &rd, Filter &f);
+    template<typename Fn>
+    static bool read_array(Reader &rd, Fn &&fn);
+};
+
+
+
+}
+
+
+
+#endif /* SRC_NOSTR_SERVER_MESSAGE_PARSER_H_ */
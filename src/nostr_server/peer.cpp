@@ -6,9 +6,11 @@
 
 #include "peer.h"
 #include "protocol.h"
+#include "message_parser.h"
 
 #include <openssl/sha.h>
 #include <sstream>
+#include <type_traits>
 namespace nostr_server {
 
 Peer::Peer(coroserver::http::ServerRequest &req, PApp app, const ServerOptions & options,
@@ -17,7 +19,6 @@ Peer::Peer(coroserver::http::ServerRequest &req, PApp app, const ServerOptions &
 :_req(req)
 ,_app(std::move(app))
 ,_options(std::move(options))
-,_subscriber(_app->get_publisher())
 ,_rate_limiter(options.event_rate_window, options.event_rate_limit)
 {
 /*    _sensor.enable(std::move(ident), std::move(user_agent));
@@ -25,6 +26,7 @@ Peer::Peer(coroserver::http::ServerRequest &req, PApp app, const ServerOptions &
     _app->client_counter(1, _req.get_url());
 }
 Peer::~Peer() {
+    _app->get_subscriptions().remove_all(this);
     _app->client_counter(-1, _req.get_url());
 }
 
@@ -48,14 +50,16 @@ cocls::future<bool> Peer::client_main(coroserver::http::ServerRequest &req, PApp
     me.prepare_auth_challenge();
     me.send({commands[Command::AUTH], me._auth_nonce});
 
-    auto listener = me.listen_publisher();
     try {
         bool rep = true;
         while (rep) {
             Message msg = co_await me._stream.read();
             switch (msg.type) {
-                case Type::text:me.processMessage(msg.payload);break;
-                case Type::binary:me.processBinaryMessage(msg.payload);break;
+                case Type::text:co_await me.processMessage(msg.payload);break;
+                case Type::binary:
+                    co_await me.join_events(true);
+                    me.processBinaryMessage(msg.payload);
+                    break;
                 case Type::connClose: rep = false; continue;
                 case Type::largeFrame:
                     me.send_notice("Message too large");
@@ -63,49 +67,24 @@ cocls::future<bool> Peer::client_main(coroserver::http::ServerRequest &req, PApp
                 default: break;
             }
             co_await me._stream.wait_for_flush();
+            co_await me.join_events(false);
+            co_await me.join_replays(false);
         }
     } catch (...) {
         e = std::current_exception();
     }
-    me._subscriber.kick_me();
-    co_await listener;
+    co_await me.join_events(true);
+    co_await me.join_replays(true);
     if (e) std::rethrow_exception(e);
     co_return true;
 }
 
-template<typename Fn>
-void Peer::filter_event(const Event &doc, Fn fn) const  {
-    std::lock_guard _(_mx);
-    for (const auto &sbs: _subscriptions) {
-        bool found = false;
-        for (const auto &f: sbs.second) {
-            if (f.test(doc)) {
-                found = true;
-                break;
-            }
-        }
-        if (found) {
-            fn(sbs.first);
-        }
-    }
-}
-
-
-cocls::future<void> Peer::listen_publisher() {
-    bool nx = co_await _subscriber.next();
-    while (nx) {
-        const EventSource &v = _subscriber.value();
-        filter_event(v.first, [&](std::string_view s){
-            JSON doc = v.first.toStructured();
-            send({commands[Command::EVENT], s, &doc});
-        });
-        nx = co_await _subscriber.next();
-    }
-    co_return;
+void Peer::on_live_event(const EventSource &src, std::string_view sub_id) {
+    send_event(sub_id, src.get_json());
 }
 
 
-void Peer::processMessage(std::string_view msg_text) {
+cocls::future<void> Peer::processMessage(std::string_view msg_text) {
     if (msg_text.size() > _options.max_message_size) {
         send_notice("Text message is too long");
     }
@@ -116,6 +95,36 @@ void Peer::processMessage(std::string_view msg_text) {
             logger(buff.view());
         });
 
+        //fast path for the most frequent messages, unusual messages are parsed by DOM parser
+        {
+            Event event;
+            std::string_view id;
+            Event::ID peeked_id;
+            //duplicates are rejected before the event is parsed, hashed and verified
+            bool peeked = MessageParser::peek_event_id(msg_text, peeked_id, id);
+            std::size_t turn = _event_seq;
+            if (peeked && _app->find_event_by_id(peeked_id)) {
+                _events.emplace_back(turn, new auto(send_duplicate(std::string(id))));
+                co_await join_events(false);
+                co_return;
+            }
+            if (MessageParser::parse_event(msg_text, event, id)) {
+                //the event is processed while next messages are read
+                //the id is not looked up again, unless the message contains other id
+                _events.emplace_back(turn, new auto(on_event(std::string(id), std::move(event), peeked && event.id == peeked_id)));
+                co_await join_events(false);
+                co_return;
+            }
+            //other messages see results of previous events
+            co_await join_events(true);
+            std::string sub_id;
+            std::vector<Filter> flts;
+            if (MessageParser::parse_req(msg_text, sub_id, flts)) {
+                on_req(std::move(sub_id), std::move(flts));
+                co_return;
+            }
+        }
+
         auto msg = docdb::Structured::from_json(msg_text);
         std::string_view cmd_text = msg[0].as<std::string_view>();
 
@@ -128,7 +137,7 @@ void Peer::processMessage(std::string_view msg_text) {
 
         switch (cmd) {
             case Command::EVENT:
-                on_event(msg); break;
+                co_await on_event(msg); break;
             case Command::REQ:
                 on_req(msg);break;
             case Command::COUNT:
@@ -136,10 +145,10 @@ void Peer::processMessage(std::string_view msg_text) {
             case Command::CLOSE:
                 on_close(msg);break;
             case Command::AUTH:
-                process_auth(msg[1]);
+                co_await process_auth(msg[1]);
                 break;
             case Command::FILE:
-                on_file(msg);break;
+                co_await on_file(msg);break;
                 break;
             case Command::RETRIEVE:
                 on_retrieve(msg);break;
@@ -160,6 +169,19 @@ void Peer::processMessage(std::string_view msg_text) {
 
 cocls::suspend_point<bool> Peer::send(const JSON &msgdata) {
     std::string json = msgdata.to_json(JSON::flagUTF8);
+    return send_text(json);
+}
+
+cocls::suspend_point<bool> Peer::send_event(std::string_view sub_id, std::string_view event_json) {
+    std::string json;
+    std::string id = JSON(sub_id).to_json(JSON::flagUTF8);
+    json.reserve(event_json.size()+id.size()+12);
+    json.append("[\"").append(commands[Command::EVENT]).append("\",");
+    json.append(id).append(",").append(event_json).append("]");
+    return send_text(json);
+}
+
+cocls::suspend_point<bool> Peer::send_text(std::string_view json) {
     _req.log_message([&](auto emit){
         std::string msg = "Send: ";
         msg.append(json);
@@ -183,73 +205,38 @@ void Peer::send_error(std::string_view id, std::string_view text) {
 
 }
 
-void Peer::on_event(const JSON &msg) {
-    on_event_generic(msg[1],[&](const std::string &id, Event &&event){
-        _app->publish(std::move(event), this);
-         send({commands[Command::OK], id, true, ""});
-    },false);
-}
-template<typename Fn>
-void Peer::on_event_generic(const JSON &msg, Fn &&on_verify, bool no_special_events) {
+cocls::future<void> Peer::on_event(const JSON &msg) {
     std::string id;
+    Event event;
+    if (!parse_event(msg[1], id, event)) co_return;
+    co_await on_event(std::move(id), std::move(event));
+}
+
+cocls::future<void> Peer::on_event(std::string id, Event event, bool id_checked) {
+    co_await on_event_generic(std::move(id), std::move(event), [this](const std::string &id, Event &&event){
+        return store_event(id, std::move(event));
+    },false, id_checked);
+}
+
+cocls::future<void> Peer::store_event(std::string id, Event event) {
+    co_await _app->write_event(std::move(event), this);
+    send({commands[Command::OK], id, true, ""});
+}
+
+bool Peer::parse_event(const JSON &msg, std::string &id, Event &event) {
     try {
         id = msg["id"].as<std::string>();
-        Event event = Event::fromStructured(msg);
-        if (_app->find_event_by_id(event.id) && !no_special_events) {
-            send({commands[Command::OK], id, true, "duplicate: ok"});
-/*            _shared_sensor.update([](SharedStats &stats){++stats.duplicated_post;});*/
-            return;
-        }
-//        std::string_view pubkey = event["pubkey"].as<std::string_view>();
-        auto now = std::chrono::system_clock::now();
-        if (!_no_limit && !_rate_limiter.test_and_add(now)) {
-            send_error(id,
-                "rate-limited: you can only post "+std::to_string(_options.event_rate_limit)
-                +" events every " + std::to_string(_options.event_rate_window) + " seconds");
-            return;
-        }
-        if (!_no_limit && _options.pow>0 && !check_pow(id)){
-            send_error(id,"pow: required difficulty " + std::to_string(_options.pow));
-            return;
-        }
-        if (!_secp.has_value()) {
-            _secp.emplace();
-        }
-        if (_authent && _app->is_home_user(_auth_pubkey)) {
-            event.trusted = true;
-        }
-        if (!event.verify(*_secp)) {
-            throw std::invalid_argument("Signature verification failed");
-        }
-        const auto &k = event.kind;
-        if (k >= kind::Ephemeral_Begin && k < kind::Ephemeral_End) { //Ephemeral event  - do not store
-            if (no_special_events) throw std::invalid_argument("This event is not allowed here");
-            _app->get_publisher().publish(EventSource{std::move(event),this});
- /*           _sensor.update([&](ClientSensor &szn){szn.report_kind(kind);});*/
-            send({commands[Command::OK], id, true, ""});
-            return;
-        }
-        if (!_no_limit && _options.read_only /*&& _options.replicators.find(pubkey) == _options.replicators.npos*/) {
-            throw Blocked("Sorry, server is in read_only mode");
-        }
-        if (!_no_limit && _options.whitelisting && !event.trusted) {
-            if (!_app->check_whitelist(event.author)) {
-                if (k == kind::Encrypted_Direct_Messages || k == kind::Gift_Wrap_Event) {  //receiver must be a local user
-                    auto target = event.get_tag_content("p");
-                    auto pk = Event::Pubkey::from_hex(target);
-                    if (!_app->is_home_user(pk)) throw Blocked("Target user not found");
-                } else {
-                    throw Blocked("Not invited");
-                }
-            }
-        }
-        if (k == 5) {
-            if (no_special_events) throw std::invalid_argument("This event is not allowed here");
-            event_deletion(event);
-            return;
-        }
-        on_verify(id, std::move(event));
-/*        _sensor.update([&](ClientSensor &szn){szn.report_kind(kind);});*/
+        event = Event::fromStructured(msg);
+        return true;
+    } catch (...) {
+        send_event_error(id, std::current_exception());
+        return false;
+    }
+}
+
+void Peer::send_event_error(std::string_view id, std::exception_ptr e) {
+    try {
+        std::rethrow_exception(e);
     } catch (const EventParseException &e) {
         send_error(id, std::string("invalid: ")+e.what());
     } catch (const docdb::DuplicateKeyException &e) {
@@ -266,79 +253,273 @@ void Peer::on_event_generic(const JSON &msg, Fn &&on_verify, bool no_special_eve
     }
 }
 
+template<typename Fn>
+cocls::future<void> Peer::on_event_generic(std::string id, Event event, Fn &&on_verify, bool no_special_events, bool id_checked) {
+    //checks which don't need the signature are done in the reading thread,
+    //verification runs while next messages are read
+    std::size_t turn = _event_seq++;
+    std::unique_ptr<cocls::future<bool> > verified;
+    std::exception_ptr rejected;
+    std::string error;
+    bool duplicate = false;
+    try {
+        if (!no_special_events && !id_checked && _app->find_event_by_id(event.id)) {
+/*            _shared_sensor.update([](SharedStats &stats){++stats.duplicated_post;});*/
+            duplicate = true;
+        } else {
+//        std::string_view pubkey = event["pubkey"].as<std::string_view>();
+            auto now = std::chrono::system_clock::now();
+            if (!_no_limit && !_rate_limiter.test_and_add(now)) {
+                error = "rate-limited: you can only post "+std::to_string(_options.event_rate_limit)
+                    +" events every " + std::to_string(_options.event_rate_window) + " seconds";
+            } else if (!_no_limit && _options.pow>0 && !check_pow(id)){
+                error = "pow: required difficulty " + std::to_string(_options.pow);
+            } else {
+                if (_authent && _app->is_home_user(_auth_pubkey)) {
+                    event.trusted = true;
+                }
+                verified.reset(new auto(_app->get_verifier().verify(event.id, event.author, event.sig)));
+            }
+        }
+    } catch (...) {
+        rejected = std::current_exception();
+    }
+    //responses are sent in order of the events
+    co_await wait_turn(turn);
+    try {
+        if (duplicate) {
+            send({commands[Command::OK], id, true, "duplicate: ok"});
+        } else if (rejected) {
+            std::rethrow_exception(rejected);
+        } else if (!error.empty()) {
+            send_error(id, error);
+        } else if (!co_await *verified) {
+            throw std::invalid_argument("Signature verification failed");
+        } else {
+            const auto &k = event.kind;
+            if (k >= kind::Ephemeral_Begin && k < kind::Ephemeral_End) { //Ephemeral event  - do not store
+                if (no_special_events) throw std::invalid_argument("This event is not allowed here");
+                _app->broadcast(std::move(event), this);
+     /*           _sensor.update([&](ClientSensor &szn){szn.report_kind(kind);});*/
+                send({commands[Command::OK], id, true, ""});
+            } else {
+                if (!_no_limit && _options.read_only /*&& _options.replicators.find(pubkey) == _options.replicators.npos*/) {
+                    throw Blocked("Sorry, server is in read_only mode");
+                }
+                if (!_no_limit && _options.whitelisting && !event.trusted) {
+                    if (!_app->check_whitelist(event.author)) {
+                        if (k == kind::Encrypted_Direct_Messages || k == kind::Gift_Wrap_Event) {  //receiver must be a local user
+                            auto target = event.get_tag_content("p");
+                            auto pk = Event::Pubkey::from_hex(target);
+                            if (!_app->is_home_user(pk)) throw Blocked("Target user not found");
+                        } else {
+                            throw Blocked("Not invited");
+                        }
+                    }
+                }
+                if (k == 5) {
+                    if (no_special_events) throw std::invalid_argument("This event is not allowed here");
+                    event_deletion(event);
+                } else if constexpr(std::is_same_v<std::invoke_result_t<Fn, const std::string &, Event &&>, cocls::future<void> >) {
+                    co_await on_verify(id, std::move(event));
+                } else {
+                    on_verify(id, std::move(event));
+                }
+            }
+        }
+/*        _sensor.update([&](ClientSensor &szn){szn.report_kind(kind);});*/
+    } catch (...) {
+        send_event_error(id, std::current_exception());
+    }
+    next_turn();
+}
+
+cocls::future<void> Peer::wait_turn(std::size_t turn) {
+    return [&](cocls::promise<void> prom) {
+        std::unique_lock lk(_mx);
+        if (_event_turn == turn) {
+            lk.unlock();
+            prom();
+            return;
+        }
+        _event_waiting.emplace(turn, std::move(prom));
+    };
+}
+
+void Peer::next_turn() {
+    std::unique_lock lk(_mx);
+    auto iter = _event_waiting.find(++_event_turn);
+    if (iter == _event_waiting.end()) return;
+    auto prom = std::move(iter->second);
+    _event_waiting.erase(iter);
+    lk.unlock();
+    //resumes the next event in this thread
+    prom();
+}
+
+cocls::future<void> Peer::join_events(bool all) {
+    //events are finished in order, so the oldest events are joined first
+    while (!_events.empty() && (all || _events.size() >= max_pending_events
+            || _events.front().first < _event_turn)) {
+        co_await *_events.front().second;
+        _events.pop_front();
+    }
+}
+
+cocls::future<void> Peer::send_duplicate(std::string id) {
+    std::size_t turn = _event_seq++;
+    co_await wait_turn(turn);
+    send({commands[Command::OK], id, true, "duplicate: ok"});
+    next_turn();
+}
 
 
-void Peer::on_req(const docdb::Structured &msg) {
-    std::lock_guard _(_mx);
 
+void Peer::on_req(const docdb::Structured &msg) {
     const auto &rq = msg.array();
-    std::size_t limit = 0;
     std::vector<Filter> flts;
     std::string subid = rq[1].as<std::string>();
     for (std::size_t pos = 2; pos < rq.size(); ++pos) {
-        auto filter = Filter::create(rq[pos]);
+        flts.push_back(Filter::create(rq[pos]));
+    }
+    on_req(std::move(subid), std::move(flts));
+}
+
+void Peer::on_req(std::string subid, std::vector<Filter> flts) {
+    std::lock_guard _(_mx);
+
+    std::size_t limit = 0;
+    for (const Filter &filter: flts) {
         if (filter.limit.has_value()) {
             limit = std::max<std::size_t>(limit, *filter.limit);
         } else {
             limit = static_cast<std::size_t>(-1);
         }
-        flts.push_back(filter);
     }
 
 
-    _app->find_in_index(_rscalc, flts);
+    //register subscription first, so no event stored during the replay is lost
+    _app->get_subscriptions().add(this, subid, flts);
+    //events stored after this point are delivered as live events, the replay
+    //skips them. An event whose commit overlaps the registration can still
+    //be delivered twice, clients must tolerate duplicates (NIP-01)
+    docdb::DocID last_id = _app->get_storage().get_rev();
+    cancel_replay(subid);
 
-    auto candidates = _rscalc.pop();
-    if (!candidates.is_inverted()) {
+    auto state = std::make_shared<Replay>();
+    state->sub_id = std::move(subid);
+    _replays.emplace_back(state, new auto(replay(state, std::move(flts), limit, last_id)));
+/*    _sensor.update([&](ClientSensor &szn){
+        ++szn.query_counter;
+        szn.subscriptions = _subscriptions.size();
+     });*/
 
-        const auto &storage = _app->get_storage();
+}
 
-        std::sort(candidates.begin(), candidates.end(), [&](const auto &a, const auto &b){
-            return a.value > b.value;
+std::string Peer::render_stored_event(const FlatEvent &ev) {
+    auto sevent = ev.toStructured();
+    if (ev.nip97) {
+        sevent.set("file_url", get_file_url(ev.id, ev.get_tag_content("m")));
+        sevent.set("nip97", true);
+    }
+    sevent.set("karma",_app->get_karma(ev.author));
+    return sevent.to_json(JSON::flagUTF8);
+}
+
+std::string Peer::render_stored_event(const EventView &view) {
+    std::string_view stored = view.json();
+    if (stored.empty()) return render_stored_event(view.decode());
+    //extras are spliced before the closing bracket
+    std::string out;
+    out.reserve(stored.size()+32);
+    out.append(stored.substr(0, stored.size()-1));
+    if (view.nip97) {
+        std::string_view mime;
+        view.for_each_tag([&](std::string_view name, std::string_view value){
+            if (name == "m") mime = value;
+            return true;
         });
+        out.append(",\"file_url\":").append(JSON(get_file_url(view.id, mime)).to_json(JSON::flagUTF8));
+        out.append(",\"nip97\":true");
+    }
+    out.append(",\"karma\":").append(std::to_string(_app->get_karma(view.author)));
+    out.push_back('}');
+    return out;
+}
 
-        for (const auto &cd: candidates) {
-            if (!limit) break;
-            auto doc = storage.find(cd.id);
-            if (doc) {
-                const EventOrAttachment &evatt = doc->document;
-                if (std::holds_alternative<Event>(evatt)) {
-                    const Event &ev = std::get<Event>(evatt);
-                    for (const auto &f: flts) {
-                        if (f.test(ev)) {
-                            auto sevent = ev.toStructured();
-                            if (ev.nip97) {
-                                std::string url ("http");
-                                url.append(std::string_view(_req.get_url()).substr(2));
-                                url.append(_app->get_attachment_link(ev.id, ev.get_tag_content("m")));
-                                sevent.set("file_url", url);
-                                sevent.set("nip97", true);
-                            }
-                            sevent.set("karma",_app->get_karma(ev.author));
-                            if (!send({commands[Command::EVENT], subid, sevent})) return;
-                            --limit;
-                            break;
-                        }
-                    }
-                } else{
-                    _req.log_message("ID doesn't point to event:"+std::to_string(cd.id), static_cast<int>(PeerServerity::error));
-                }
-            } else {
-                _req.log_message("Event missing for ID:"+std::to_string(cd.id), static_cast<int>(PeerServerity::error));
+std::string Peer::get_file_url(const Event::ID &id, std::string_view mime) {
+    std::string url ("http");
+    url.append(std::string_view(_req.get_url()).substr(2));
+    url.append(_app->get_attachment_link(id, mime));
+    return url;
+}
+
+cocls::future<void> Peer::replay(PReplay state, std::vector<Filter> flts, std::size_t limit, docdb::DocID last_id) {
+    std::stop_token stp = state->stop.get_token();
+    //bytes added to _replay_unflushed by this replay
+    std::size_t unflushed = 0;
+    try {
+        //query runs in the query pool, IO thread is not blocked
+        IApp::DocIDList found = co_await _app->query(flts, limit);
+        for (docdb::DocID id: found) {
+            if (!limit || stp.stop_requested()) break;
+            if (id > last_id) continue;
+            auto doc = _app->find_event(id);
+            if (!doc) {
+                _req.log_message("Event missing for ID:"+std::to_string(id), static_cast<int>(PeerServerity::error));
+                continue;
+            }
+            const EventView &view = *doc;
+            if (!view.is_event()) {
+                _req.log_message("ID doesn't point to event:"+std::to_string(id), static_cast<int>(PeerServerity::error));
+                continue;
+            }
+            //only accepted events are decoded
+            if (std::none_of(flts.begin(), flts.end(), [&](const Filter &f){return f.test(view);})) continue;
+            std::string json = render_stored_event(view);
+            if (!send_event(state->sub_id, json)) break;
+            --limit;
+            unflushed += json.size();
+            if (_replay_unflushed.fetch_add(json.size()) + json.size() >= _options.replay_buffer_size) {
+                //wait until the client reads the data, keeps memory held per connection bounded
+                co_await _stream.wait_for_flush();
+                _replay_unflushed -= unflushed;
+                unflushed = 0;
             }
         }
-
-
+        if (!stp.stop_requested()) {
+            send({commands[Command::EOSE], state->sub_id});
+        }
+    } catch (std::exception &e) {
+        _req.log_message([&](auto emit){
+            std::string msg = "Replay exception:";
+            msg.append(e.what());
+            emit(msg);
+        },static_cast<int>(PeerServerity::warn));
     }
+    //the replay doesn't send more data, its bytes don't hold other replays
+    _replay_unflushed -= unflushed;
+    state->finished = true;
+}
 
-    send({commands[Command::EOSE], subid});
-
-    _subscriptions.emplace_back(subid, std::move(flts));
-/*    _sensor.update([&](ClientSensor &szn){
-        ++szn.query_counter;
-        szn.subscriptions = _subscriptions.size();
-     });*/
+void Peer::cancel_replay(std::string_view sub_id) {
+    for (auto &[st, task]: _replays) {
+        if (st->sub_id == sub_id) st->stop.request_stop();
+    }
+}
 
+cocls::future<void> Peer::join_replays(bool all) {
+    auto iter = _replays.begin();
+    while (iter != _replays.end()) {
+        auto &[st, task] = *iter;
+        if (all) st->stop.request_stop();
+        if (all || st->finished) {
+            co_await *task;
+            iter = _replays.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
 }
 
 void Peer::on_count(const docdb::Structured &msg) {
@@ -349,19 +530,35 @@ void Peer::on_count(const docdb::Structured &msg) {
        auto filter = Filter::create(rq[pos]);
        flts.push_back(filter);
     }
-    _app->find_in_index(_rscalc, flts);
-    std::intmax_t count = _rscalc.top().size();
-    send({commands[Command::COUNT], subid, {{"count", count}}});
+    auto state = std::make_shared<Replay>();
+    state->sub_id = std::move(subid);
+    _replays.emplace_back(state, new auto(count(state, std::move(flts))));
+}
+
+cocls::future<void> Peer::count(PReplay state, std::vector<Filter> flts) {
+    try {
+        IApp::CountResult r = co_await _app->count(std::move(flts));
+        if (!state->stop.stop_requested()) {
+            if (r.approximate) {
+                send({commands[Command::COUNT], state->sub_id, {{"count", static_cast<std::intmax_t>(r.count)},{"approximate", true}}});
+            } else {
+                send({commands[Command::COUNT], state->sub_id, {{"count", static_cast<std::intmax_t>(r.count)}}});
+            }
+        }
+    } catch (std::exception &e) {
+        _req.log_message([&](auto emit){
+            std::string msg = "Count exception:";
+            msg.append(e.what());
+            emit(msg);
+        },static_cast<int>(PeerServerity::warn));
+    }
+    state->finished = true;
 }
 
 void Peer::on_close(const docdb::Structured &msg) {
-    std::lock_guard _(_mx);
-    std::string id = msg[1].as<std::string>();
-    auto iter = std::remove_if(_subscriptions.begin(), _subscriptions.end(),
-            [&](const auto &s) {
-        return s.first == id;
-    });
-    _subscriptions.erase(iter, _subscriptions.end());
+    std::string_view id = msg[1].as<std::string_view>();
+    _app->get_subscriptions().remove(this, id);
+    cancel_replay(id);
 /*    _sensor.update([&](ClientSensor &szn){
         szn.subscriptions = _subscriptions.size();
         szn.max_subscriptions = std::max(szn.max_subscriptions, szn.subscriptions);
@@ -375,26 +572,28 @@ void Peer::event_deletion(const Event &event) {
     auto id = Event::ID::from_hex(evtodel);
     flts[0].ids.push_back({id, id.size()});
     auto &storage = _app->get_storage();
-    docdb::Batch b;
     _app->find_in_index(_rscalc, flts);
-    for(const auto &row: _rscalc.top()) {
-        auto fdoc = storage.find(row.id);
-        if (fdoc && std::holds_alternative<Event>(fdoc->document)) {
-            const Event &ev = std::get<Event>(fdoc->document);
-            if (ev.author != event.author) {
-                throw std::invalid_argument("pubkey missmatch");
-            }
-            if (deleted_something) {
-                storage.erase(b, row.id);
-            } else {
-                storage.put(b, event, row.id);
-                deleted_something = true;
+    const auto &view_storage = _app->get_view_storage();
+    _app->commit([&](docdb::Batch &b){
+        for(const auto &row: _rscalc.top()) {
+            //only author is checked, the event doesn't need to be decoded
+            auto fdoc = view_storage.find(row.id);
+            if (fdoc && fdoc->document.is_event()) {
+                const EventView &ev = fdoc->document;
+                if (ev.author != event.author) {
+                    throw std::invalid_argument("pubkey missmatch");
+                }
+                if (deleted_something) {
+                    storage.erase(b, row.id);
+                } else {
+                    storage.put(b, event, row.id);
+                    deleted_something = true;
+                }
             }
         }
-    }
+    });
     if (deleted_something) {
-        storage.get_db()->commit_batch(b);
-        _app->get_publisher().publish(EventSource{event,this});
+        _app->broadcast(Event(event), this);
     }
     send({commands[Command::OK], event.id.to_hex(), true, ""});
     /*_sensor.update([&](ClientSensor &szn){szn.report_kind(5);});*/
@@ -429,15 +628,13 @@ void Peer::prepare_auth_challenge() {
     }
 }
 
-void Peer::process_auth(const JSON &jevent) {
+cocls::future<void> Peer::process_auth(const JSON &jevent) {
     auto id = jevent["id"].as<std::string_view>();
     try {
         Event event = Event::fromStructured(jevent);
+        bool verified = co_await _app->get_verifier().verify(event.id, event.author, event.sig);
         auto now = std::chrono::system_clock::now();
-        if (!_secp.has_value()) {
-            _secp.emplace();
-        }
-        if (!event.verify(*_secp)) {
+        if (!verified) {
             throw std::invalid_argument("Signature verification failed");
         }
         auto k = event.kind;
@@ -508,8 +705,11 @@ void Peer::processBinaryMessage(std::string_view msg_text) {
     }
 }
 
-void Peer::on_file(const JSON &msg) {
-        on_event_generic(msg[1], [&](const std::string &id, Event &&event){
+cocls::future<void> Peer::on_file(const JSON &msg) {
+        std::string id;
+        Event event;
+        if (!parse_event(msg[1], id, event)) co_return;
+        co_await on_event_generic(std::move(id), std::move(event), [this](const std::string &id, Event &&event){
             try {
                 if (event.kind != kind::File_Header) throw FileError::unsupported_kind;
 
@@ -14,21 +14,22 @@
 #include <coroserver/websocket_stream.h>
 #include <coroserver/http_server_request.h>
 
+#include <atomic>
+#include <deque>
 #include <map>
+#include <memory>
 #include <set>
+#include <stop_token>
 
 
 namespace nostr_server {
 
 
-class Peer {
+class Peer: public SubscriptionIndex::Listener {
 public:
 
     static cocls::future<bool> client_main(coroserver::http::ServerRequest &req, PApp app, const ServerOptions &options);
 
-    using Subscriptions = std::vector<std::pair<std::string,std::vector<Filter> > >;
-
-
 
 protected:
     Peer(coroserver::http::ServerRequest &req, PApp app, const ServerOptions & options,
@@ -39,11 +40,9 @@ protected:
     coroserver::http::ServerRequest &_req;
     PApp _app;
     const ServerOptions & _options;
-    EventSubscriber _subscriber;
     coroserver::ws::Stream _stream;
     IApp::RecordSetCalculator _rscalc;
     mutable std::mutex _mx;
-    std::optional<SignatureTools> _secp;
     RateLimiter _rate_limiter;
     bool _authent = false;
     bool _no_limit = false;
@@ -53,38 +52,116 @@ protected:
 
     std::optional<Event> _file_event;
 
-    Subscriptions _subscriptions;
-
-    cocls::future<void> listen_publisher();
-
-
-    void processMessage(std::string_view msg_text);
+    ///State of running replay of stored events (or pending COUNT)
+    struct Replay {
+        std::string sub_id;
+        std::stop_source stop;
+        std::atomic<bool> finished = false;
+    };
+    using PReplay = std::shared_ptr<Replay>;
+    using ReplayTask = std::pair<PReplay, std::unique_ptr<cocls::future<void> > >;
+
+    std::vector<ReplayTask> _replays;
+    ///count of bytes sent by replays and not confirmed by a flush
+    /**
+     * Each replay subtracts only bytes it added itself, so concurrent replays
+     * don't reset each others budget
+     */
+    std::atomic<std::size_t> _replay_unflushed = 0;
+
+    ///Replays stored events
+    /**
+     * @param state state of the replay
+     * @param flts filters
+     * @param limit max count of events
+     * @param last_id last document id stored before the subscription was registered.
+     * Newer documents are skipped, because they are delivered as live events.
+     */
+    cocls::future<void> replay(PReplay state, std::vector<Filter> flts, std::size_t limit, docdb::DocID last_id);
+    cocls::future<void> count(PReplay state, std::vector<Filter> flts);
+    void cancel_replay(std::string_view sub_id);
+    cocls::future<void> join_replays(bool all);
+
+    ///maximum count of received events processed at once
+    static constexpr std::size_t max_pending_events = 64;
+    ///Received event being processed {turn, task}
+    using EventTask = std::pair<std::size_t, std::unique_ptr<cocls::future<void> > >;
+    ///Events being processed, the oldest first
+    /**
+     * Signatures of the events are verified while next messages are read,
+     * so events of one connection are verified in one batch. Responses and
+     * other processing are done in order of the events (see wait_turn())
+     */
+    std::deque<EventTask> _events;
+    ///turn of the next received event
+    std::size_t _event_seq = 0;
+    ///turn of the event allowed to continue (count of finished events)
+    std::atomic<std::size_t> _event_turn = 0;
+    ///events waiting for their turn
+    std::map<std::size_t, cocls::promise<void> > _event_waiting;
+
+    ///Wait until previous events are finished
+    cocls::future<void> wait_turn(std::size_t turn);
+    ///Finish the turn, next event can continue
+    void next_turn();
+    ///Joins finished events
+    /**
+     * @param all join all events. Otherwise only finished events are
+     * joined and the oldest events, if there are too many events
+     */
+    cocls::future<void> join_events(bool all);
+    ///Sends response to a duplicate event in its turn
+    cocls::future<void> send_duplicate(std::string id);
+    std::string render_stored_event(const FlatEvent &ev);
+    ///Renders event using stored JSON, falls back to decoding when JSON is not stored
+    std::string render_stored_event(const EventView &view);
+    std::string get_file_url(const Event::ID &id, std::string_view mime);
+
+    virtual void on_live_event(const EventSource &src, std::string_view sub_id) override;
+
+
+    cocls::future<void> processMessage(std::string_view msg_text);
     void processBinaryMessage(std::string_view msg_text);
 
     cocls::suspend_point<bool> send(const docdb::Structured &msgdata);
+    cocls::suspend_point<bool> send_text(std::string_view json);
+    ///Sends EVENT message, event's JSON is inserted as is
+    cocls::suspend_point<bool> send_event(std::string_view sub_id, std::string_view event_json);
 
 /*    telemetry::UniqueSensor<ClientSensor> _sensor;
     telemetry::SharedSensor<SharedStats> _shared_sensor;*/
 
 
+    ///Processes received event
+    /**
+     * @param id id of the event as received
+     * @param event event
+     * @param on_verify called with verified event
+     * @param no_special_events don't process special events and don't check duplicates
+     * @param id_checked the caller already found, that the event is not stored
+     */
     template<typename Fn>
-    void on_event_generic(const JSON &msg, Fn &&on_verify, bool no_special_events);
-
-    void on_event(const JSON &msg);
+    cocls::future<void> on_event_generic(std::string id, Event event, Fn &&on_verify, bool no_special_events, bool id_checked = false);
+    ///Parses event from the DOM, sends error when the event is not valid
+    bool parse_event(const JSON &msg, std::string &id, Event &event);
+    void send_event_error(std::string_view id, std::exception_ptr e);
+
+    cocls::future<void> on_event(const JSON &msg);
+    cocls::future<void> on_event(std::string id, Event event, bool id_checked = false);
+    ///stores the event and sends OK after it is committed
+    cocls::future<void> store_event(std::string id, Event event);
     void on_req(const JSON &msg);
+    void on_req(std::string subid, std::vector<Filter> flts);
     void on_count(const JSON &msg);
     void on_close(const JSON &msg);
-    void on_file(const JSON &msg);
+    cocls::future<void> on_file(const JSON &msg);
     void on_retrieve(const JSON &msg);
 
     void event_deletion(const Event &event);
 
-    template<typename Fn>
-    void filter_event(const Event &doc, Fn fn) const;
-
     bool check_pow(std::string_view id) const;
     void prepare_auth_challenge();
-    void process_auth(const JSON &jmsg);
+    cocls::future<void> process_auth(const JSON &jmsg);
     void send_error(std::string_view id, std::string_view text);
     void send_notice(std::string_view text);
 
@@ -6,11 +6,40 @@
 
 #include <cocls/publisher.h>
 #include <docdb/structured_document.h>
+#include <docdb/json.h>
+
+#include <memory>
+#include <mutex>
 
 namespace nostr_server {
 
 
-using EventSource = std::pair<Event, const void *>;
+///Published event and its publisher
+/**
+ * The JSON of the event is rendered on the first request and shared
+ * by all copies of the object, so the event is serialized only once
+ * regardless on count of subscribers
+ */
+class EventSource: public std::pair<Event, const void *> {
+public:
+    using std::pair<Event, const void *>::pair;
+
+    ///Retrieve JSON of the event (rendered on the first call)
+    std::string_view get_json() const {
+        SharedJSON &sj = *_json;
+        std::call_once(sj.flag, [&]{
+            sj.text = first.toStructured().to_json(docdb::Structured::flagUTF8);
+        });
+        return sj.text;
+    }
+
+protected:
+    struct SharedJSON {
+        std::once_flag flag;
+        std::string text;
+    };
+    std::shared_ptr<SharedJSON> _json = std::make_shared<SharedJSON>();
+};
 
 using EventPublisher = cocls::publisher<EventSource>;
 using EventSubscriber = cocls::subscriber<EventSource>;
@@ -0,0 +1,106 @@
+/*
+ * query_cursor.cpp
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#include "query_cursor.h"
+
+namespace nostr_server {
+
+IndexCursor::IndexCursor(Opener opener, std::time_t until)
+    :_opener(std::move(opener))
+    ,_range(_opener(until)) {
+    next();
+}
+
+void IndexCursor::next() {
+    if (!_end && !_range(_cur.id, _cur.time)) _end = true;
+}
+
+void IndexCursor::seek(const CursorItem &target) {
+    for (int i = 0; i < linear_seek_steps && !_end && _cur.before(target); ++i) next();
+    if (!_end && _cur.before(target)) {
+        //target is far, skip the gap by reopening the range
+        _range = _opener(target.time);
+        next();
+    }
+    //range is opened with widened bounds
+    while (!_end && _cur.before(target)) next();
+}
+
+OrCursor::OrCursor(std::vector<PQueryCursor> cursors):_cursors(std::move(cursors)) {
+    update();
+}
+
+void OrCursor::update() {
+    const QueryCursor *best = nullptr;
+    for (const auto &c: _cursors) {
+        if (!c->at_end() && (!best || c->current().before(best->current()))) best = c.get();
+    }
+    _end = best == nullptr;
+    if (best) _cur = best->current();
+}
+
+void OrCursor::next() {
+    if (_end) return;
+    //all cursors at the current item are moved, so the item is not repeated
+    for (auto &c: _cursors) {
+        if (!c->at_end() && c->current() == _cur) c->next();
+    }
+    update();
+}
+
+void OrCursor::seek(const CursorItem &target) {
+    for (auto &c: _cursors) c->seek(target);
+    update();
+}
+
+AndCursor::AndCursor(std::vector<PQueryCursor> cursors):_cursors(std::move(cursors)) {
+    _end = _cursors.empty();
+    find_match();
+}
+
+void AndCursor::find_match() {
+    while (!_end) {
+        //the furthest cursor is the target for all other cursors
+        CursorItem target;
+        bool first = true;
+        for (const auto &c: _cursors) {
+            if (c->at_end()) {
+                _end = true;
+                return;
+            }
+            if (first || target.before(c->current())) target = c->current();
+            first = false;
+        }
+        bool match = true;
+        for (auto &c: _cursors) {
+            if (c->current().before(target)) c->seek(target);
+            if (c->at_end()) {
+                _end = true;
+                return;
+            }
+            match = match && c->current() == target;
+        }
+        if (match) {
+            _cur = target;
+            return;
+        }
+    }
+}
+
+void AndCursor::next() {
+    if (_end) return;
+    _cursors.front()->next();
+    find_match();
+}
+
+void AndCursor::seek(const CursorItem &target) {
+    if (_end) return;
+    for (auto &c: _cursors) c->seek(target);
+    find_match();
+}
+
+}
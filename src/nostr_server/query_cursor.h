@@ -0,0 +1,110 @@
+/*
+ * query_cursor.h
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_NOSTR_SERVER_QUERY_CURSOR_H_
+#define SRC_NOSTR_SERVER_QUERY_CURSOR_H_
+
+#include <docdb/database.h>
+
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace nostr_server {
+
+///Position of the cursor, documents are ordered by time and id, newest first
+struct CursorItem {
+    std::time_t time = 0;
+    docdb::DocID id = 0;
+
+    ///returns true, if this item is returned before the other item
+    bool before(const CursorItem &other) const {
+        return time == other.time?id > other.id:time > other.time;
+    }
+    bool operator==(const CursorItem &other) const {
+        return time == other.time && id == other.id;
+    }
+};
+
+///Lazy cursor over documents ordered by time (newest first)
+/**
+ * Cursors are combined by AND (leapfrog join) and OR (merge). Nothing is
+ * materialized, the documents are read from the indexes as the cursor moves.
+ * Duplicated items can appear, the consumer must ignore them
+ */
+class QueryCursor {
+public:
+    virtual ~QueryCursor() = default;
+
+    bool at_end() const {return _end;}
+    ///current item, valid if at_end() is false
+    const CursorItem &current() const {return _cur;}
+    ///move to next item
+    virtual void next() = 0;
+    ///move to first item, which is not before the target
+    virtual void seek(const CursorItem &target) = 0;
+
+protected:
+    CursorItem _cur;
+    bool _end = false;
+};
+
+using PQueryCursor = std::unique_ptr<QueryCursor>;
+
+///Cursor over the range of an index
+class IndexCursor: public QueryCursor {
+public:
+    ///Reads next row of the range, returns false at the end
+    using Range = std::function<bool(docdb::DocID &, std::time_t &)>;
+    ///Opens the range starting at given time (walking to older)
+    using Opener = std::function<Range(std::time_t)>;
+
+    IndexCursor(Opener opener, std::time_t until);
+
+    virtual void next() override;
+    virtual void seek(const CursorItem &target) override;
+
+protected:
+    ///count of rows skipped by reading before the range is reopened
+    static constexpr int linear_seek_steps = 8;
+
+    Opener _opener;
+    Range _range;
+};
+
+///Union of cursors
+class OrCursor: public QueryCursor {
+public:
+    explicit OrCursor(std::vector<PQueryCursor> cursors);
+
+    virtual void next() override;
+    virtual void seek(const CursorItem &target) override;
+
+protected:
+    std::vector<PQueryCursor> _cursors;
+    void update();
+};
+
+///Intersection of cursors (leapfrog join)
+class AndCursor: public QueryCursor {
+public:
+    explicit AndCursor(std::vector<PQueryCursor> cursors);
+
+    virtual void next() override;
+    virtual void seek(const CursorItem &target) override;
+
+protected:
+    std::vector<PQueryCursor> _cursors;
+    void find_match();
+};
+
+}
+
+
+
+#endif /* SRC_NOSTR_SERVER_QUERY_CURSOR_H_ */
@@ -0,0 +1,61 @@
+/*
+ * query_executor.cpp
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#include "query_executor.h"
+
+namespace nostr_server {
+
+QueryExecutor::QueryExecutor(unsigned int threads, Dispatcher &dispatcher)
+    :_dispatcher(dispatcher) {
+    _threads.reserve(threads);
+    for (unsigned int i = 0; i < threads; ++i) {
+        _threads.emplace_back([this]{worker();});
+    }
+}
+
+QueryExecutor::~QueryExecutor() {
+    {
+        std::lock_guard _(_mx);
+        _exit = true;
+    }
+    _cond.notify_all();
+    for (auto &t: _threads) t.join();
+}
+
+void QueryExecutor::enqueue(PTask &&task) {
+    if (_threads.empty()) {
+        ++_executed;
+        task->run(nullptr);
+        return;
+    }
+    {
+        std::lock_guard _(_mx);
+        _queue.push_back(std::move(task));
+        ++_queue_depth;
+    }
+    _cond.notify_one();
+}
+
+void QueryExecutor::worker() {
+    std::unique_lock lk(_mx);
+    while (true) {
+        _cond.wait(lk, [&]{return _exit || !_queue.empty();});
+        if (_exit) break;
+        PTask task = std::move(_queue.front());
+        _queue.pop_front();
+        --_queue_depth;
+        lk.unlock();
+        auto wait = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - task->enqueued);
+        _wait_time_us += wait.count();
+        ++_executed;
+        task->run(&_dispatcher);
+        task.reset();
+        lk.lock();
+    }
+}
+
+}
@@ -0,0 +1,139 @@
+/*
+ * query_executor.h
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_NOSTR_SERVER_QUERY_EXECUTOR_H_
+#define SRC_NOSTR_SERVER_QUERY_EXECUTOR_H_
+
+#include "dispatcher.h"
+
+#include <cocls/future.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace nostr_server {
+
+///Pool of threads which execute database queries
+/**
+ * Queries are not executed on IO threads, because an expensive query
+ * (fulltext, wide tag search) would stall all connections handled by the
+ * same IO thread. The query is passed to the pool and the caller
+ * receives a future, which is resolved once the query is done.
+ *
+ * @note awaiting coroutine is resumed by the dispatcher, workers only
+ * execute queries
+ */
+class QueryExecutor {
+public:
+
+    ///Construct the pool
+    /**
+     * @param threads count of worker threads. If zero is passed, queries
+     * are executed directly in the calling thread
+     * @param dispatcher dispatcher which resolves the futures
+     */
+    QueryExecutor(unsigned int threads, Dispatcher &dispatcher);
+    ~QueryExecutor();
+
+    QueryExecutor(const QueryExecutor &) = delete;
+    QueryExecutor &operator=(const QueryExecutor &) = delete;
+
+    ///Execute function in the pool
+    /**
+     * @param fn function to execute
+     * @return future resolved by return value of the function. Exception
+     * thrown by the function is passed to the future
+     */
+    template<typename Fn>
+    cocls::future<std::invoke_result_t<Fn> > run(Fn &&fn);
+
+    ///Count of queries waiting for a worker
+    std::size_t get_queue_depth() const {return _queue_depth;}
+    ///Count of executed queries
+    std::size_t get_executed() const {return _executed;}
+    ///Total time spent in the queue (seconds)
+    double get_wait_time() const {return _wait_time_us * 0.000001;}
+
+protected:
+
+    using Clock = std::chrono::steady_clock;
+
+    class AbstractTask {
+    public:
+        Clock::time_point enqueued = Clock::now();
+        virtual ~AbstractTask() = default;
+        ///Run the task
+        /**
+         * @param disp dispatcher used to resolve the promise, nullptr to resolve directly
+         */
+        virtual void run(Dispatcher *disp) = 0;
+    };
+
+    template<typename Fn, typename T>
+    class Task: public AbstractTask {
+    public:
+        Task(Fn &&fn, cocls::promise<T> &&prom):_fn(std::forward<Fn>(fn)),_prom(std::move(prom)) {}
+        virtual void run(Dispatcher *disp) override {
+            try {
+                if constexpr(std::is_void_v<T>) {
+                    _fn();
+                    complete(disp);
+                } else {
+                    complete(disp, _fn());
+                }
+            } catch (...) {
+                complete(disp, std::current_exception());
+            }
+        }
+    protected:
+        std::decay_t<Fn> _fn;
+        cocls::promise<T> _prom;
+
+        template<typename ... Args>
+        void complete(Dispatcher *disp, Args && ... args) {
+            if (disp) disp->resolve(std::move(_prom), std::forward<Args>(args)...);
+            else _prom(std::forward<Args>(args)...);
+        }
+    };
+
+    using PTask = std::unique_ptr<AbstractTask>;
+
+    Dispatcher &_dispatcher;
+    std::mutex _mx;
+    std::condition_variable _cond;
+    std::deque<PTask> _queue;
+    std::vector<std::thread> _threads;
+    bool _exit = false;
+
+    std::atomic<std::size_t> _queue_depth = 0;
+    std::atomic<std::size_t> _executed = 0;
+    std::atomic<std::uint64_t> _wait_time_us = 0;
+
+    void enqueue(PTask &&task);
+    void worker();
+};
+
+template<typename Fn>
+inline cocls::future<std::invoke_result_t<Fn> > QueryExecutor::run(Fn &&fn) {
+    using T = std::invoke_result_t<Fn>;
+    return [&](cocls::promise<T> prom) {
+        enqueue(std::make_unique<Task<Fn, T> >(std::forward<Fn>(fn), std::move(prom)));
+    };
+}
+
+}
+
+
+
+#endif /* SRC_NOSTR_SERVER_QUERY_EXECUTOR_H_ */
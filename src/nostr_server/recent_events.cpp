@@ -0,0 +1,129 @@
+/*
+ * recent_events.cpp
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#include "recent_events.h"
+
+#include <algorithm>
+#include <mutex>
+
+namespace nostr_server {
+
+static bool item_less(std::time_t t1, docdb::DocID id1, std::time_t t2, docdb::DocID id2) {
+    return t1 == t2?id1 < id2:t1 < t2;
+}
+
+RecentEvents::RecentEvents(const std::vector<Event::Kind> &kinds, std::size_t max_count, std::time_t max_age)
+    :_max_count(max_count)
+    ,_max_age(max_age) {
+    if (max_count) {
+        for (auto k: kinds) _rings[k];
+    }
+}
+
+std::time_t RecentEvents::get_min_time() const {
+    return _max_age?std::time(nullptr) - _max_age:0;
+}
+
+void RecentEvents::set_horizon(Event::Kind kind, std::time_t horizon) {
+    auto iter = _rings.find(kind);
+    if (iter == _rings.end()) return;
+    std::unique_lock _(_mx);
+    iter->second.horizon = std::max(iter->second.horizon, horizon);
+}
+
+void RecentEvents::add(docdb::DocID id, PEvent ev) {
+    auto iter = _rings.find(ev->kind);
+    if (iter == _rings.end()) return;
+    Ring &r = iter->second;
+    std::time_t t = ev->created_at;
+    std::unique_lock _(_mx);
+    //event older than horizon is not needed, the ring is not complete there
+    if (t < r.horizon) return;
+    //events arrive mostly in order, search from the end
+    auto pos = r.items.end();
+    while (pos != r.items.begin() && item_less(t, id, std::prev(pos)->time, std::prev(pos)->id)) --pos;
+    r.items.insert(pos, Item{t, id, std::move(ev)});
+    trim(r);
+}
+
+void RecentEvents::remove(docdb::DocID id, const Event &ev) {
+    auto iter = _rings.find(ev.kind);
+    if (iter == _rings.end()) return;
+    Ring &r = iter->second;
+    std::time_t t = ev.created_at;
+    std::unique_lock _(_mx);
+    auto pos = std::lower_bound(r.items.begin(), r.items.end(), t, [](const Item &itm, std::time_t t){
+        return itm.time < t;
+    });
+    while (pos != r.items.end() && pos->time == t) {
+        if (pos->id == id) {
+            r.items.erase(pos);
+            return;
+        }
+        ++pos;
+    }
+}
+
+void RecentEvents::trim(Ring &r) {
+    std::time_t min_time = get_min_time();
+    while (!r.items.empty() && (r.items.size() > _max_count || r.items.front().time < min_time)) {
+        //events of the same time can remain, the horizon must be above them
+        r.horizon = std::max(r.horizon, r.items.front().time + 1);
+        r.items.pop_front();
+    }
+}
+
+bool RecentEvents::collect(const Ring &r, const Filter &f, std::size_t limit, std::vector<const Item *> &out) {
+    std::time_t since = f.since.has_value()?*f.since:0;
+    std::size_t cnt = 0;
+    for (auto iter = r.items.rbegin(); iter != r.items.rend(); ++iter) {
+        const Item &itm = *iter;
+        //events below the horizon can be incomplete
+        if (itm.time < since || itm.time < r.horizon) break;
+        if (f.test(*itm.ev)) {
+            out.push_back(&itm);
+            //all newer events are in the ring, so these are the newest events
+            if (++cnt >= limit) return true;
+        }
+    }
+    return since >= r.horizon;
+}
+
+bool RecentEvents::find(const std::vector<Filter> &filters, std::size_t limit, std::vector<docdb::DocID> &result) const {
+    if (_rings.empty()) return false;
+    for (const Filter &f: filters) {
+        if (f.kinds.empty() || !f.ids.empty() || !f.ft_search.empty()
+                || std::any_of(f.kinds.begin(), f.kinds.end(), [&](Event::Kind k){return !is_hot(k);})) {
+            ++_misses;
+            return false;
+        }
+    }
+    std::vector<const Item *> found;
+    std::shared_lock _(_mx);
+    for (const Filter &f: filters) {
+        for (auto k: f.kinds) {
+            //each ring provides its newest events, the merge selects the newest of them
+            if (!collect(_rings.find(k)->second, f, limit, found)) {
+                ++_misses;
+                return false;
+            }
+        }
+    }
+    std::sort(found.begin(), found.end(), [](const Item *a, const Item *b){
+        return item_less(b->time, b->id, a->time, a->id);
+    });
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+    result.clear();
+    for (const Item *itm: found) {
+        if (result.size() >= limit) break;
+        result.push_back(itm->id);
+    }
+    ++_hits;
+    return true;
+}
+
+}
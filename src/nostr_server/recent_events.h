@@ -0,0 +1,113 @@
+/*
+ * recent_events.h
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_NOSTR_SERVER_RECENT_EVENTS_H_
+#define SRC_NOSTR_SERVER_RECENT_EVENTS_H_
+#include "filter.h"
+
+#include <docdb/database.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace nostr_server {
+
+///Window of the most recent events of selected kinds kept in memory
+/**
+ * Each kind has own ring ordered by time. The ring holds all stored
+ * events of the kind, which are not older than its horizon. The horizon
+ * moves forward as old events are dropped (by count or by age).
+ *
+ * A query is answered from the memory, when it is proven, that the result
+ * is complete, i.e. the limit was reached above the horizon or the 'since'
+ * of the filter is not older than the horizon. Otherwise the caller
+ * must use the indexes
+ */
+class RecentEvents {
+public:
+
+    using PEvent = std::shared_ptr<const Event>;
+
+    ///Construct the window
+    /**
+     * @param kinds kinds kept in memory. If empty, the window is disabled
+     * @param max_count maximum count of events per kind
+     * @param max_age maximum age of events in seconds, 0 - no limit
+     */
+    RecentEvents(const std::vector<Event::Kind> &kinds, std::size_t max_count, std::time_t max_age);
+
+    bool is_enabled() const {return !_rings.empty();}
+    ///returns true, if the kind is kept in memory
+    bool is_hot(Event::Kind kind) const {return _rings.find(kind) != _rings.end();}
+
+    std::size_t get_max_count() const {return _max_count;}
+    ///Oldest time kept in memory, 0 - no limit
+    std::time_t get_min_time() const;
+
+    ///Sets horizon of the ring after the events were loaded by add()
+    /**
+     * @param kind kind
+     * @param horizon all stored events of the kind, which are not older than
+     * the horizon, were loaded
+     */
+    void set_horizon(Event::Kind kind, std::time_t horizon);
+
+    ///Add stored event (ignored when the kind is not kept)
+    void add(docdb::DocID id, PEvent ev);
+    ///Remove event (when it is removed from the storage)
+    void remove(docdb::DocID id, const Event &ev);
+
+    ///Find events
+    /**
+     * @param filters filters of the query
+     * @param limit maximum count of events
+     * @param result ordered result (newest first)
+     * @retval true found, the result is complete
+     * @retval false can't be answered from the memory
+     */
+    bool find(const std::vector<Filter> &filters, std::size_t limit, std::vector<docdb::DocID> &result) const;
+
+    std::size_t get_hits() const {return _hits;}
+    std::size_t get_misses() const {return _misses;}
+
+protected:
+
+    struct Item {
+        std::time_t time;
+        docdb::DocID id;
+        PEvent ev;
+    };
+
+    struct Ring {
+        ///events ordered by time and id (oldest first)
+        std::deque<Item> items;
+        ///all events since horizon are in the ring
+        std::time_t horizon = 0;
+    };
+
+    std::unordered_map<Event::Kind, Ring> _rings;
+    std::size_t _max_count;
+    std::time_t _max_age;
+    mutable std::shared_mutex _mx;
+    mutable std::atomic<std::size_t> _hits = 0;
+    mutable std::atomic<std::size_t> _misses = 0;
+
+    ///drop old events and move the horizon
+    void trim(Ring &r);
+    ///collect newest matching events of the ring, returns false if result can be incomplete
+    static bool collect(const Ring &r, const Filter &f, std::size_t limit, std::vector<const Item *> &out);
+};
+
+}
+
+
+
+#endif /* SRC_NOSTR_SERVER_RECENT_EVENTS_H_ */
@@ -334,7 +334,7 @@ std::string RelayBot::delete_group_post(const SignatureTools::PrivateKey &pk,
             Event ev = create_event(5, "", {{"e", id}});
             _sigtool.sign(pk,ev);
             _app->publish(std::move(ev), this);
-            _app->get_storage().erase(set.back().id);
+            _app->erase_event(set.back().id);
             return id;
         }
     }
@@ -0,0 +1,245 @@
+/*
+ * result_cache.cpp
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#include "result_cache.h"
+
+#include <algorithm>
+#include <numeric>
+#include <utility>
+
+namespace nostr_server {
+
+template<typename T>
+static void append_value(std::string &out, const T &val) {
+    auto p = reinterpret_cast<const char *>(&val);
+    out.append(p, sizeof(val));
+}
+
+static void append_string(std::string &out, std::string_view str) {
+    append_value(out, str.size());
+    out.append(str);
+}
+
+///Creates key of the filter, since is not included
+static std::string filter_key(const Filter &f) {
+    std::string out;
+    auto append_keys = [&](char section, const auto &keys) {
+        //only the prefix is significant
+        std::vector<std::string> v;
+        for (const auto &[k, len]: keys) {
+            std::size_t l = std::min<std::size_t>(len, k.size());
+            v.push_back(std::string(reinterpret_cast<const char *>(k.data()), l));
+        }
+        std::sort(v.begin(), v.end());
+        out.push_back(section);
+        append_value(out, v.size());
+        for (const auto &x: v) append_string(out, x);
+    };
+    append_keys('a', f.authors);
+    append_keys('i', f.ids);
+    auto kinds = f.kinds;
+    std::sort(kinds.begin(), kinds.end());
+    out.push_back('k');
+    append_value(out, kinds.size());
+    for (auto k: kinds) append_value(out, k);
+    auto tags = f.tags;
+    for (auto &[t, values]: tags) std::sort(values.begin(), values.end());
+    std::sort(tags.begin(), tags.end());
+    for (const auto &[t, values]: tags) {
+        out.push_back('#');
+        out.push_back(t);
+        append_value(out, values.size());
+        for (const auto &x: values) append_string(out, x);
+    }
+    if (f.until.has_value()) {
+        out.push_back('u');
+        append_value(out, *f.until);
+    }
+    out.push_back('s');
+    append_string(out, f.ft_search);
+    return out;
+}
+
+ResultCache::Query::Query(const std::vector<Filter> &filters, std::size_t limit)
+    :_limit(limit)
+    ,_cacheable(!filters.empty() && filters.size() <= max_filters) {
+    if (!_cacheable) return;
+    std::vector<std::pair<std::string, std::time_t> > keys;
+    keys.reserve(filters.size());
+    for (const auto &f: filters) {
+        keys.push_back({filter_key(f), f.since.has_value()?*f.since:0});
+    }
+    //filters are joined by OR, so their order doesn't matter
+    std::vector<std::size_t> pos(filters.size());
+    std::iota(pos.begin(), pos.end(), 0);
+    std::sort(pos.begin(), pos.end(), [&](std::size_t a, std::size_t b){
+        return keys[a] < keys[b];
+    });
+    _order.resize(filters.size());
+    append_value(_key, limit);
+    for (std::size_t i = 0; i < pos.size(); ++i) {
+        _order[pos[i]] = i;
+        append_string(_key, keys[pos[i]].first);
+        _since.push_back(keys[pos[i]].second);
+    }
+}
+
+ResultCache::Ticket::Ticket(Ticket &&other)
+    :_owner(std::exchange(other._owner, nullptr))
+    ,_key(std::move(other._key))
+    ,_version(other._version) {}
+
+ResultCache::Ticket::~Ticket() {
+    if (_owner) _owner->release(*this);
+}
+
+ResultCache::ResultCache(std::size_t max_size):_max_size(max_size) {}
+
+ResultCache::~ResultCache() {
+    _watch.remove_all(this);
+}
+
+bool ResultCache::find(const Query &q, std::vector<docdb::DocID> &result) {
+    if (!_max_size || !q._cacheable) return false;
+    std::lock_guard _(_mx);
+    auto iter = _map.find(q._key);
+    if (iter == _map.end()) {
+        ++_misses;
+        return false;
+    }
+    const Entry &e = *iter->second;
+    //cached result can't contain events older than its since
+    for (std::size_t i = 0; i < e.since.size(); ++i) {
+        if (q._since[i] < e.since[i]) {
+            ++_misses;
+            return false;
+        }
+    }
+    result.clear();
+    for (const Item &itm: e.items) {
+        if (result.size() >= q._limit) break;
+        bool match = false;
+        for (std::size_t i = 0; i < q._since.size() && !match; ++i) {
+            match = (itm.filters & (1U << i)) && itm.time >= q._since[i];
+        }
+        if (match) result.push_back(itm.id);
+    }
+    //events after the end of incomplete result can match, unless they are older than any since
+    std::time_t min_since = *std::min_element(q._since.begin(), q._since.end());
+    if (result.size() < q._limit && !e.complete
+            && (e.items.empty() || e.items.back().time >= min_since)) {
+        ++_misses;
+        return false;
+    }
+    _lru.splice(_lru.begin(), _lru, iter->second);
+    ++_hits;
+    return true;
+}
+
+ResultCache::Ticket ResultCache::watch(const Query &q, const std::vector<Filter> &filters) {
+    Ticket t;
+    if (!_max_size || !q._cacheable) return t;
+    std::lock_guard _(_mx);
+    Pending &p = _pending[q._key];
+    if (p.refs == 0 && _map.find(q._key) == _map.end()) {
+        //registration is shared by queries with different since
+        std::vector<Filter> flts = filters;
+        for (auto &f: flts) f.since.reset();
+        _watch.add(this, q._key, std::move(flts));
+    }
+    ++p.refs;
+    t._owner = this;
+    t._key = q._key;
+    t._version = p.version;
+    return t;
+}
+
+void ResultCache::release(Ticket &ticket) {
+    std::lock_guard _(_mx);
+    ticket._owner = nullptr;
+    auto iter = _pending.find(ticket._key);
+    if (iter == _pending.end()) return;
+    if (--iter->second.refs == 0) {
+        _pending.erase(iter);
+        unwatch(ticket._key);
+    }
+}
+
+void ResultCache::unwatch(const std::string &key) {
+    if (_map.find(key) == _map.end() && _pending.find(key) == _pending.end()) {
+        _watch.remove(this, key);
+    }
+}
+
+void ResultCache::put(Ticket &&ticket, const Query &q, const Result &result) {
+    if (!ticket._owner) return;
+    Ticket t(std::move(ticket));
+    Entry e;
+    e.key = q._key;
+    e.since = q._since;
+    e.complete = result.size() < q._limit;
+    e.items.reserve(result.size());
+    for (const Item &itm: result) {
+        //mask is stored in normalized order
+        std::uint32_t mask = 0;
+        for (std::size_t i = 0; i < q._order.size(); ++i) {
+            if (itm.filters & (1U << i)) mask |= 1U << q._order[i];
+        }
+        e.items.push_back({itm.time, itm.id, mask});
+    }
+    e.size = e.key.size() + e.items.size() * sizeof(Item) + entry_overhead;
+    if (e.size > _max_size) return;
+
+    std::lock_guard _(_mx);
+    //a matching event was published during the query, the result can be outdated
+    auto pnd = _pending.find(t._key);
+    if (pnd == _pending.end() || pnd->second.version != t._version) return;
+    auto iter = _map.find(q._key);
+    if (iter != _map.end()) remove(iter->second);
+    _lru.push_front(std::move(e));
+    Entry &ne = _lru.front();
+    _map.emplace(ne.key, _lru.begin());
+    _size += ne.size;
+    while (_size > _max_size) {
+        remove(std::prev(_lru.end()));
+    }
+}
+
+///keys of cached queries matching the event, collected during the invalidation
+static thread_local std::vector<std::string> matching_keys;
+
+void ResultCache::on_live_event(const EventSource &, std::string_view sub_id) {
+    matching_keys.push_back(std::string(sub_id));
+}
+
+void ResultCache::invalidate(const EventSource &src) {
+    if (!_max_size) return;
+    matching_keys.clear();
+    _watch.publish(src);
+    if (matching_keys.empty()) return;
+    std::lock_guard _(_mx);
+    for (const auto &k: matching_keys) {
+        auto pnd = _pending.find(k);
+        if (pnd != _pending.end()) ++pnd->second.version;
+        auto iter = _map.find(k);
+        if (iter != _map.end()) {
+            remove(iter->second);
+            ++_invalidations;
+        }
+    }
+    matching_keys.clear();
+}
+
+void ResultCache::remove(LRUList::iterator iter) {
+    _map.erase(iter->key);
+    std::string key = std::move(iter->key);
+    _size -= iter->size;
+    _lru.erase(iter);
+    unwatch(key);
+}
+
+}
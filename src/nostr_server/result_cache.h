@@ -0,0 +1,175 @@
+/*
+ * result_cache.h
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_NOSTR_SERVER_RESULT_CACHE_H_
+#define SRC_NOSTR_SERVER_RESULT_CACHE_H_
+#include "subscription_index.h"
+
+#include <docdb/database.h>
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace nostr_server {
+
+///Cache of results of queries shared by all peers
+/**
+ * The query is identified by the normalized form of its filters, without
+ * 'since' and without the subscription id. The cached result remembers
+ * which filter matched each event, so the result can be reused by
+ * a query with more recent 'since'.
+ *
+ * Cached queries are registered in own SubscriptionIndex. When an event
+ * is published (or removed), the index finds cached queries which match
+ * the event and these are dropped (see invalidate())
+ *
+ * The query is registered before it is executed (see watch()), so an event
+ * committed during the execution is always seen either by the query or by
+ * the invalidation. Only the queries actually matching the event are
+ * affected
+ */
+class ResultCache: public SubscriptionIndex::Listener {
+public:
+
+    ///maximum count of filters of the cached query (mask of matching filters)
+    static constexpr std::size_t max_filters = 32;
+
+    ///Item of the result
+    struct Item {
+        std::time_t time;
+        docdb::DocID id;
+        ///bit mask of filters matching the event (in order of the query)
+        std::uint32_t filters;
+    };
+    using Result = std::vector<Item>;
+
+    ///Normalized query
+    class Query {
+    public:
+        Query(const std::vector<Filter> &filters, std::size_t limit);
+        ///returns false, if the query cannot be cached
+        bool is_cacheable() const {return _cacheable;}
+    protected:
+        std::string _key;
+        ///since of each filter in normalized order
+        std::vector<std::time_t> _since;
+        ///normalized position of each filter
+        std::vector<std::size_t> _order;
+        std::size_t _limit;
+        bool _cacheable;
+        friend class ResultCache;
+    };
+
+    ///Registration of the executed query, pass it to put()
+    /** If the ticket is not passed to put(), the registration is released
+     * by the destructor */
+    class Ticket {
+    public:
+        Ticket() = default;
+        Ticket(Ticket &&other);
+        Ticket &operator=(Ticket &&other) = delete;
+        ~Ticket();
+    protected:
+        ResultCache *_owner = nullptr;
+        std::string _key;
+        std::size_t _version = 0;
+        friend class ResultCache;
+    };
+
+    ///Construct the cache
+    /**
+     * @param max_size maximum size in bytes, if zero is passed, the cache is disabled
+     */
+    explicit ResultCache(std::size_t max_size);
+    ~ResultCache();
+
+    bool is_enabled() const {return _max_size != 0;}
+
+    ///Find result of the query
+    /**
+     * @param q query
+     * @param result receives ordered list of matching events
+     * @retval true found
+     * @retval false not found
+     */
+    bool find(const Query &q, std::vector<docdb::DocID> &result);
+    ///Register the query before it is executed
+    /**
+     * @param q query
+     * @param filters filters of the query
+     * @return ticket, pass it to put()
+     */
+    Ticket watch(const Query &q, const std::vector<Filter> &filters);
+    ///Store result of the query
+    /**
+     * @param ticket ticket retrieved before the query was executed. The result is
+     * not stored, if a matching event was published or removed since then
+     * @param q query
+     * @param result result
+     */
+    void put(Ticket &&ticket, const Query &q, const Result &result);
+    ///Drop cached queries which match the event
+    void invalidate(const EventSource &src);
+
+    std::size_t get_hits() const {return _hits;}
+    std::size_t get_misses() const {return _misses;}
+    std::size_t get_invalidations() const {return _invalidations;}
+    ///Current size of cached results in bytes
+    std::size_t get_size() const {return _size;}
+
+protected:
+
+    static constexpr std::size_t entry_overhead = 256;
+
+    struct Entry {
+        std::string key;
+        std::vector<std::time_t> since;
+        Result items;
+        ///result contains all matching events (limit was not reached)
+        bool complete;
+        std::size_t size;
+    };
+
+    using LRUList = std::list<Entry>;
+
+    ///Query being executed
+    struct Pending {
+        ///count of tickets
+        std::size_t refs = 0;
+        ///changed by every invalidation of the query
+        std::size_t version = 0;
+    };
+
+    std::size_t _max_size;
+    std::mutex _mx;
+    LRUList _lru;
+    std::unordered_map<std::string_view, LRUList::iterator> _map;
+    std::unordered_map<std::string, Pending> _pending;
+    SubscriptionIndex _watch;
+
+    std::atomic<std::size_t> _hits = 0;
+    std::atomic<std::size_t> _misses = 0;
+    std::atomic<std::size_t> _invalidations = 0;
+    std::atomic<std::size_t> _size = 0;
+
+    virtual void on_live_event(const EventSource &src, std::string_view sub_id) override;
+    void remove(LRUList::iterator iter);
+    void release(Ticket &ticket);
+    ///removes the query from the index, if it is not needed
+    void unwatch(const std::string &key);
+};
+
+}
+
+
+
+#endif /* SRC_NOSTR_SERVER_RESULT_CACHE_H_ */
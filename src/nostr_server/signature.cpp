@@ -26,6 +26,12 @@ void SignatureTools::Deleter::operator ()(secp256k1_context *ptr) const {
     secp256k1_context_destroy(ptr);
 }
 
+bool SignatureTools::randomize() {
+    unsigned char seed[32];
+    if (RAND_bytes(seed, sizeof(seed)) != 1) return false;
+    return secp256k1_context_randomize(ctx.get(), seed) != 0;
+}
+
 bool SignatureTools::verify(const HashSha256 &id, const PublicKey &pubkey, const Signature &sig) const {
     secp256k1_xonly_pubkey pubkey_parsed;
     if (!secp256k1_xonly_pubkey_parse(ctx.get(), &pubkey_parsed, pubkey.data())) return false;
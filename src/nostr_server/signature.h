@@ -30,6 +30,9 @@ public:
 
     SignatureTools();
 
+    ///Randomize context (protects signing against side channel attacks)
+    bool randomize();
+
     bool verify(const HashSha256 &id, const PublicKey &pubkey, const Signature &sig) const ;
     bool sign(const PrivateKey &key, const HashSha256 &id, Signature &sig, PublicKey &pub) const;
     bool public_key(const PrivateKey &priv, PublicKey &pub) const;
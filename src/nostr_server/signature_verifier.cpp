@@ -0,0 +1,74 @@
+/*
+ * signature_verifier.cpp
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#include "signature_verifier.h"
+
+#include <algorithm>
+
+namespace nostr_server {
+
+SignatureVerifier::SignatureVerifier(unsigned int threads, Dispatcher &dispatcher, std::size_t max_batch)
+    :_dispatcher(dispatcher)
+    ,_max_batch(std::max<std::size_t>(max_batch, 1)) {
+    _threads.reserve(threads);
+    for (unsigned int i = 0; i < threads; ++i) {
+        _threads.emplace_back([this]{worker();});
+    }
+}
+
+SignatureVerifier::~SignatureVerifier() {
+    {
+        std::lock_guard _(_mx);
+        _exit = true;
+    }
+    _cond.notify_all();
+    for (auto &t: _threads) t.join();
+}
+
+cocls::future<bool> SignatureVerifier::verify(const HashSha256 &id, const PublicKey &pubkey, const Signature &sig) {
+    return [&](cocls::promise<bool> prom) {
+        if (_threads.empty()) {
+            //verification doesn't modify the context, it can be shared
+            prom(_direct.verify(id, pubkey, sig));
+            return;
+        }
+        {
+            std::lock_guard _(_mx);
+            _queue.push_back(Request{id, pubkey, sig, std::move(prom)});
+        }
+        _cond.notify_one();
+    };
+}
+
+void SignatureVerifier::worker() {
+    SignatureTools tools;
+    tools.randomize();
+    std::vector<Request> batch;
+    std::vector<bool> results;
+    std::unique_lock lk(_mx);
+    while (true) {
+        _cond.wait(lk, [&]{return _exit || !_queue.empty();});
+        if (_exit) break;
+        while (!_queue.empty() && batch.size() < _max_batch) {
+            batch.push_back(std::move(_queue.front()));
+            _queue.pop_front();
+        }
+        lk.unlock();
+        results.clear();
+        for (const Request &r: batch) {
+            results.push_back(tools.verify(r.id, r.pubkey, r.sig));
+        }
+        //awaiting coroutines are resumed by the dispatcher, the worker continues with next batch
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            _dispatcher.resolve(std::move(batch[i].result), static_cast<bool>(results[i]));
+        }
+        batch.clear();
+        lk.lock();
+    }
+}
+
+}
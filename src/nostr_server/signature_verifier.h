@@ -0,0 +1,89 @@
+/*
+ * signature_verifier.h
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_NOSTR_SERVER_SIGNATURE_VERIFIER_H_
+#define SRC_NOSTR_SERVER_SIGNATURE_VERIFIER_H_
+
+#include "signature.h"
+#include "dispatcher.h"
+
+#include <cocls/future.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nostr_server {
+
+///Shared service which verifies signatures of events
+/**
+ * The service has fixed count of worker threads, every thread has own
+ * randomized secp256k1 context. Requests are queued and workers take
+ * them in batches, so the queue is not locked for every signature.
+ * Every request is completed through own future
+ *
+ * @note awaiting coroutine is resumed by the dispatcher, workers only
+ * verify signatures
+ */
+class SignatureVerifier {
+public:
+
+    using HashSha256 = SignatureTools::HashSha256;
+    using PublicKey = SignatureTools::PublicKey;
+    using Signature = SignatureTools::Signature;
+
+    ///Construct the service
+    /**
+     * @param threads count of worker threads. If zero is passed, signatures
+     * are verified in the calling thread
+     * @param dispatcher dispatcher which resolves the futures
+     * @param max_batch maximum count of requests taken by a worker at once
+     */
+    SignatureVerifier(unsigned int threads, Dispatcher &dispatcher, std::size_t max_batch = 64);
+    ~SignatureVerifier();
+
+    SignatureVerifier(const SignatureVerifier &) = delete;
+    SignatureVerifier &operator=(const SignatureVerifier &) = delete;
+
+    ///Verify signature
+    /**
+     * @param id event id (hash)
+     * @param pubkey author
+     * @param sig signature
+     * @return future resolved with result of the verification
+     */
+    cocls::future<bool> verify(const HashSha256 &id, const PublicKey &pubkey, const Signature &sig);
+
+protected:
+
+    struct Request {
+        HashSha256 id;
+        PublicKey pubkey;
+        Signature sig;
+        cocls::promise<bool> result;
+    };
+
+    Dispatcher &_dispatcher;
+    std::size_t _max_batch;
+    std::mutex _mx;
+    std::condition_variable _cond;
+    std::deque<Request> _queue;
+    std::vector<std::thread> _threads;
+    bool _exit = false;
+    ///context used when there are no workers
+    SignatureTools _direct;
+
+    void worker();
+};
+
+}
+
+
+
+#endif /* SRC_NOSTR_SERVER_SIGNATURE_VERIFIER_H_ */
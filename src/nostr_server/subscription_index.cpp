@@ -0,0 +1,185 @@
+/*
+ * subscription_index.cpp
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#include "subscription_index.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+namespace nostr_server {
+
+std::size_t SubscriptionIndex::author_key(const Event::Pubkey &pk) {
+    std::size_t r;
+    std::memcpy(&r, pk.data(), sizeof(r));
+    return r;
+}
+
+std::size_t SubscriptionIndex::tag_key(char tag, std::string_view value) {
+    std::hash<std::string_view> hasher;
+    return hasher(value) * 31 + tag;
+}
+
+SubscriptionIndex::Bucket &SubscriptionIndex::get_bucket(BucketType type, std::size_t key) {
+    switch (type) {
+        case BucketType::author: return _by_author[key];
+        case BucketType::tag: return _by_tag[key];
+        case BucketType::kind: return _by_kind[key];
+        default: return _any;
+    }
+}
+
+void SubscriptionIndex::register_subscription(const PSubscription &psbs) {
+    Subscription &sbs = *psbs;
+    for (const Filter &f: sbs.filters) {
+        bool full_authors = !f.authors.empty() && std::all_of(f.authors.begin(), f.authors.end(), [](const auto &a){
+            return a.second == a.first.size();
+        });
+        if (full_authors) {
+            for (const auto &a: f.authors) sbs.keys.push_back({BucketType::author, author_key(a.first)});
+        } else if (!f.tags.empty()) {
+            //filter with empty list of tag values never matches
+            const auto &[t, values] = f.tags.front();
+            for (const auto &v: values) sbs.keys.push_back({BucketType::tag, tag_key(t, v)});
+        } else if (!f.kinds.empty()) {
+            for (const auto &k: f.kinds) sbs.keys.push_back({BucketType::kind, k});
+        } else {
+            sbs.keys.push_back({BucketType::any, 0});
+        }
+    }
+    std::sort(sbs.keys.begin(), sbs.keys.end());
+    sbs.keys.erase(std::unique(sbs.keys.begin(), sbs.keys.end()), sbs.keys.end());
+    for (const auto &[type, key]: sbs.keys) {
+        get_bucket(type, key).push_back(psbs);
+    }
+    ++_count;
+}
+
+void SubscriptionIndex::unregister_subscription(const Subscription &sbs) {
+    for (const auto &[type, key]: sbs.keys) {
+        Bucket &b = get_bucket(type, key);
+        b.erase(std::remove_if(b.begin(), b.end(), [&](const PSubscription &s){
+            return s.get() == &sbs;
+        }), b.end());
+        if (b.empty() && type != BucketType::any) {
+            switch (type) {
+                case BucketType::author: _by_author.erase(key);break;
+                case BucketType::tag: _by_tag.erase(key);break;
+                case BucketType::kind: _by_kind.erase(key);break;
+                default: break;
+            }
+        }
+    }
+    --_count;
+}
+
+void SubscriptionIndex::add(Listener *owner, std::string sub_id, std::vector<Filter> filters) {
+    std::vector<PSubscription> removed;
+    {
+        std::unique_lock _(_mx);
+        auto &lst = _owners[owner];
+        POwnerState state = lst.empty()?std::make_shared<OwnerState>(owner):lst.front()->owner;
+        auto iter = std::find_if(lst.begin(), lst.end(), [&](const PSubscription &s){
+            return s->id == sub_id;
+        });
+        if (iter != lst.end()) {
+            unregister_subscription(**iter);
+            removed.push_back(std::move(*iter));
+            lst.erase(iter);
+        }
+        lst.push_back(std::make_shared<Subscription>(Subscription{std::move(state), std::move(sub_id), std::move(filters), {}}));
+        register_subscription(lst.back());
+    }
+    deactivate(removed);
+}
+
+void SubscriptionIndex::remove(Listener *owner, std::string_view sub_id) {
+    std::vector<PSubscription> removed;
+    {
+        std::unique_lock _(_mx);
+        auto oiter = _owners.find(owner);
+        if (oiter == _owners.end()) return;
+        auto &lst = oiter->second;
+        auto iter = std::find_if(lst.begin(), lst.end(), [&](const PSubscription &s){
+            return s->id == sub_id;
+        });
+        if (iter != lst.end()) {
+            unregister_subscription(**iter);
+            removed.push_back(std::move(*iter));
+            lst.erase(iter);
+        }
+        if (lst.empty()) _owners.erase(oiter);
+    }
+    deactivate(removed);
+}
+
+void SubscriptionIndex::remove_all(Listener *owner) {
+    std::vector<PSubscription> removed;
+    {
+        std::unique_lock _(_mx);
+        auto oiter = _owners.find(owner);
+        if (oiter == _owners.end()) return;
+        for (const auto &s: oiter->second) {
+            unregister_subscription(*s);
+        }
+        removed = std::move(oiter->second);
+        _owners.erase(oiter);
+    }
+    deactivate(removed);
+}
+
+void SubscriptionIndex::deactivate(const std::vector<PSubscription> &subs) {
+    //the index is not locked, so waiting doesn't block other owners
+    for (const PSubscription &s: subs) {
+        std::unique_lock _(s->owner->mx);
+        s->active = false;
+    }
+}
+
+std::size_t SubscriptionIndex::size() const {
+    std::shared_lock _(_mx);
+    return _count;
+}
+
+void SubscriptionIndex::collect(const BucketMap &map, std::size_t key, std::vector<PSubscription> &out) {
+    auto iter = map.find(key);
+    if (iter != map.end()) {
+        out.insert(out.end(), iter->second.begin(), iter->second.end());
+    }
+}
+
+void SubscriptionIndex::publish(const EventSource &src) const {
+    const Event &ev = src.first;
+    std::vector<PSubscription> candidates;
+    {
+        std::shared_lock _(_mx);
+        candidates.insert(candidates.end(), _any.begin(), _any.end());
+        collect(_by_author, author_key(ev.author), candidates);
+        collect(_by_kind, ev.kind, candidates);
+        if (!_by_tag.empty()) {
+            for (const auto &t: ev.tags) {
+                if (t.tag.size() == 1) collect(_by_tag, tag_key(t.tag[0], t.content), candidates);
+            }
+        }
+    }
+    //one subscription can be registered under multiple keys
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    for (const PSubscription &s: candidates) {
+        for (const Filter &f: s->filters) {
+            if (f.test(ev)) {
+                //removed subscription is skipped, owner can't be destroyed during the call
+                std::shared_lock _(s->owner->mx);
+                if (s->active) s->owner->owner->on_live_event(src, s->id);
+                break;
+            }
+        }
+    }
+}
+
+
+}
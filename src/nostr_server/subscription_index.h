@@ -0,0 +1,127 @@
+/*
+ * subscription_index.h
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_NOSTR_SERVER_SUBSCRIPTION_INDEX_H_
+#define SRC_NOSTR_SERVER_SUBSCRIPTION_INDEX_H_
+#include "filter.h"
+
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace nostr_server {
+
+///Inverted index of active subscriptions
+/**
+ * Each filter of a subscription is registered under keys of one
+ * constraint - authors, values of the first tag or kinds. Filters which
+ * cannot be indexed are stored in the catch-all bucket. When an event
+ * is published, only buckets related to the event are visited, candidates
+ * are tested by the Filter::test and only owners of the matching
+ * subscriptions are notified.
+ *
+ * Matching subscriptions are collected under the lock, but owners are
+ * notified after the lock is released, so a slow owner doesn't block
+ * changes of subscriptions.
+ */
+class SubscriptionIndex {
+public:
+
+    ///Owner of subscriptions (usually a Peer)
+    class Listener {
+    public:
+        virtual ~Listener() = default;
+        ///Called for every subscription of the listener, which matches the event
+        /**
+         * @param src published event
+         * @param sub_id subscription id
+         *
+         * @note called without the lock of the index. The function must not
+         * remove subscriptions of the same owner (deadlock)
+         */
+        virtual void on_live_event(const EventSource &src, std::string_view sub_id) = 0;
+    };
+
+    ///Add or replace subscription
+    /**
+     * @param owner owner of the subscription
+     * @param sub_id subscription id. If the owner already has a subscription
+     * with the same id, it is replaced
+     * @param filters filters
+     */
+    void add(Listener *owner, std::string sub_id, std::vector<Filter> filters);
+    ///Remove subscription
+    /** Waits for pending notifications of the owner */
+    void remove(Listener *owner, std::string_view sub_id);
+    ///Remove all subscriptions of given owner
+    /** Must be called before the owner is destroyed. Waits for pending
+     * notifications of the owner, so the owner is not called after return */
+    void remove_all(Listener *owner);
+    ///Notify owners of all subscriptions matching the event
+    void publish(const EventSource &src) const;
+
+    ///Count of active subscriptions
+    std::size_t size() const;
+
+protected:
+
+    enum class BucketType {
+        author,
+        tag,
+        kind,
+        any
+    };
+
+    ///Shared by all subscriptions of the owner
+    struct OwnerState {
+        Listener *owner;
+        ///held shared during notification, exclusive when subscription is deactivated
+        std::shared_mutex mx;
+    };
+
+    using POwnerState = std::shared_ptr<OwnerState>;
+
+    struct Subscription {
+        POwnerState owner;
+        std::string id;
+        std::vector<Filter> filters;
+        std::vector<std::pair<BucketType, std::size_t> > keys;
+        ///cleared when removed (under owner->mx), pending notification is skipped
+        bool active = true;
+    };
+
+    using PSubscription = std::shared_ptr<Subscription>;
+    using Bucket = std::vector<PSubscription>;
+    using BucketMap = std::unordered_map<std::size_t, Bucket>;
+
+    mutable std::shared_mutex _mx;
+    BucketMap _by_author;
+    BucketMap _by_tag;
+    BucketMap _by_kind;
+    Bucket _any;
+    std::unordered_map<Listener *, std::vector<PSubscription> > _owners;
+    std::size_t _count = 0;
+
+    static std::size_t author_key(const Event::Pubkey &pk);
+    static std::size_t tag_key(char tag, std::string_view value);
+
+    Bucket &get_bucket(BucketType type, std::size_t key);
+    void register_subscription(const PSubscription &sbs);
+    void unregister_subscription(const Subscription &sbs);
+    static void collect(const BucketMap &map, std::size_t key, std::vector<PSubscription> &out);
+    ///marks removed subscriptions inactive, waits for pending notifications
+    static void deactivate(const std::vector<PSubscription> &subs);
+};
+
+
+}
+
+
+
+#endif /* SRC_NOSTR_SERVER_SUBSCRIPTION_INDEX_H_ */
@@ -25,6 +25,25 @@ void register_scavengers(telemetry::open_metrics::Collector &col) {
     auto database_memory_size = defMetric(MetricType::gauge,"nostr_database_memory_usage","","bytes");
     auto database_events = defMetric(MetricType::counter,"nostr_database_events","","");
     auto database_duplicated = defMetric(MetricType::counter,"nostr_database_duplicated_posts","","");
+    auto query_queue_depth = defMetric(MetricType::gauge,"nostr_query_queue_depth","","");
+    auto query_executed = defMetric(MetricType::counter,"nostr_query_executed","","");
+    auto query_wait_time = defMetric(MetricType::counter,"nostr_query_wait_time","","seconds");
+    auto event_cache_hits = defMetric(MetricType::counter,"nostr_event_cache_hits","","");
+    auto event_cache_misses = defMetric(MetricType::counter,"nostr_event_cache_misses","","");
+    auto event_cache_evictions = defMetric(MetricType::counter,"nostr_event_cache_evictions","","");
+    auto event_cache_size = defMetric(MetricType::gauge,"nostr_event_cache_size","","bytes");
+    auto result_cache_hits = defMetric(MetricType::counter,"nostr_result_cache_hits","","");
+    auto result_cache_misses = defMetric(MetricType::counter,"nostr_result_cache_misses","","");
+    auto result_cache_invalidations = defMetric(MetricType::counter,"nostr_result_cache_invalidations","","");
+    auto result_cache_size = defMetric(MetricType::gauge,"nostr_result_cache_size","","bytes");
+    auto recent_events_hits = defMetric(MetricType::counter,"nostr_recent_events_hits","","");
+    auto recent_events_misses = defMetric(MetricType::counter,"nostr_recent_events_misses","","");
+    auto writer_queue_depth = defMetric(MetricType::gauge,"nostr_writer_queue_depth","","");
+    auto writer_batches = defMetric(MetricType::counter,"nostr_writer_batches","","");
+    auto writer_events = defMetric(MetricType::counter,"nostr_writer_events","","");
+    auto writer_commit_time = defMetric(MetricType::counter,"nostr_writer_commit_time","","seconds");
+    auto id_filter_size = defMetric(MetricType::gauge,"nostr_id_filter_size","","");
+    auto id_filter_skipped = defMetric(MetricType::counter,"nostr_id_filter_skipped","","");
     auto client_info = defMetric(MetricType::info,"nostr_client_info","","");
     auto client_command_counts = defMetric(MetricType::counter,"nostr_client_command_count","","");
     auto client_query_counts = defMetric(MetricType::counter,"nostr_client_query_count","","");
@@ -84,6 +103,55 @@ void register_scavengers(telemetry::open_metrics::Collector &col) {
         };
     };
 
+    col.shared_sensors+=[=](QueryExecutorSensor &s) {
+        return [=](auto emit) {
+            emit(query_queue_depth, s.executor->get_queue_depth());
+            emit(query_executed, s.executor->get_executed());
+            emit(query_wait_time, s.executor->get_wait_time());
+        };
+    };
+
+    col.shared_sensors+=[=](EventCacheSensor &s) {
+        return [=](auto emit) {
+            emit(event_cache_hits, s.cache->get_hits());
+            emit(event_cache_misses, s.cache->get_misses());
+            emit(event_cache_evictions, s.cache->get_evictions());
+            emit(event_cache_size, s.cache->get_size());
+        };
+    };
+
+    col.shared_sensors+=[=](ResultCacheSensor &s) {
+        return [=](auto emit) {
+            emit(result_cache_hits, s.cache->get_hits());
+            emit(result_cache_misses, s.cache->get_misses());
+            emit(result_cache_invalidations, s.cache->get_invalidations());
+            emit(result_cache_size, s.cache->get_size());
+        };
+    };
+
+    col.shared_sensors+=[=](RecentEventsSensor &s) {
+        return [=](auto emit) {
+            emit(recent_events_hits, s.recent->get_hits());
+            emit(recent_events_misses, s.recent->get_misses());
+        };
+    };
+
+    col.shared_sensors+=[=](EventWriterSensor &s) {
+        return [=](auto emit) {
+            emit(writer_queue_depth, s.writer->get_queue_depth());
+            emit(writer_batches, s.writer->get_batches());
+            emit(writer_events, s.writer->get_events());
+            emit(writer_commit_time, s.writer->get_commit_time());
+        };
+    };
+
+    col.shared_sensors+=[=](IdFilterSensor &s) {
+        return [=](auto emit) {
+            emit(id_filter_size, s.filter->get_count());
+            emit(id_filter_skipped, s.filter->get_skipped());
+        };
+    };
+
     col.shared_sensors+=[=](SharedStats &s) {
         return [&](auto emit){
             emit(database_duplicated, s.duplicated_post);
@@ -7,6 +7,12 @@
 #include "../telemetry/sensor.h"
 
 #include "publisher.h"
+#include "query_executor.h"
+#include "event_cache.h"
+#include "result_cache.h"
+#include "recent_events.h"
+#include "event_writer.h"
+#include "id_filter.h"
 
 #include <map>
 namespace telemetry {
@@ -23,6 +29,30 @@ struct StorageSensor {
     const docdb::Storage<EventDocument> *storage = nullptr;
 };
 
+struct QueryExecutorSensor {
+    const QueryExecutor *executor = nullptr;
+};
+
+struct EventCacheSensor {
+    const EventCache *cache = nullptr;
+};
+
+struct ResultCacheSensor {
+    const ResultCache *cache = nullptr;
+};
+
+struct RecentEventsSensor {
+    const RecentEvents *recent = nullptr;
+};
+
+struct EventWriterSensor {
+    const EventWriter *writer = nullptr;
+};
+
+struct IdFilterSensor {
+    const IdFilter *filter = nullptr;
+};
+
 struct ClientSensor {
     using DefaultLock = std::mutex;
     ClientSensor(std::string ident, std::string user_agent):_connectionID(++connectionIDCounter), _ident(ident), _user_agent(user_agent) {}
@@ -0,0 +1,109 @@
+/*
+ * bench.h
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_TESTS_BENCH_H_
+#define SRC_TESTS_BENCH_H_
+#include <nostr_server/app.h>
+#include <nostr_server/event.h>
+
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace nostr_server_bench {
+
+using nostr_server::Event;
+
+///Registered benchmark
+struct Benchmark {
+    std::string_view name;
+    void (*fn)();
+};
+
+///List of all benchmarks
+std::vector<Benchmark> &registry();
+
+///Registers the benchmark (use as static variable)
+struct Register {
+    Register(std::string_view name, void (*fn)()) {
+        registry().push_back({name, fn});
+    }
+};
+
+///Count of memory allocations (operator new) since the start of the program
+std::size_t allocations();
+///Count of bytes currently allocated by operator new
+std::size_t allocated_memory();
+///Highest count of bytes allocated since last reset_peak_memory()
+std::size_t peak_memory();
+///Resets peak_memory() to current allocated_memory()
+void reset_peak_memory();
+
+///Keeps result of the computation, so the compiler can't remove it
+inline volatile std::size_t sink = 0;
+
+///Measures the function, prints throughput
+/**
+ * @param label label printed on the line
+ * @param ops count of operations performed by the function
+ * @param fn function to measure
+ * @return duration in seconds
+ */
+template<typename Fn>
+double measure(const std::string &label, std::size_t ops, Fn &&fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "  " << label << ": " << static_cast<std::size_t>(ops/sec) << " ops/s, "
+              << sec * 1e9 / ops << " ns/op" << std::endl;
+    return sec;
+}
+
+///Generates signed events
+/**
+ * @param count count of events
+ * @param kind kind of events
+ * @param authors count of distinct authors
+ * @return events ordered by created_at
+ */
+std::vector<Event> generate_events(std::size_t count, Event::Kind kind = 1, std::size_t authors = 16);
+
+///Application over an empty database in a temporary directory
+/**
+ * The database is removed, when the object is destroyed
+ */
+class TempApp {
+public:
+    ///Create the application
+    /**
+     * @param name name of the database directory
+     * @param cfg configuration, database_path is ignored
+     */
+    TempApp(std::string_view name, nostr_server::Config cfg);
+    ~TempApp();
+
+    nostr_server::App &operator*() const {return *_app;}
+    nostr_server::App *operator->() const {return _app.get();}
+
+    ///Default configuration of the benchmarks (caches and ring disabled)
+    static nostr_server::Config default_config();
+
+protected:
+    std::filesystem::path _path;
+    std::shared_ptr<nostr_server::App> _app;
+};
+
+}
+
+
+
+#endif /* SRC_TESTS_BENCH_H_ */
@@ -0,0 +1,58 @@
+/*
+ * bench_broadcast.cpp
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#include "bench.h"
+
+#include <nostr_server/publisher.h>
+
+namespace nostr_server_bench {
+
+using nostr_server::EventSource;
+using nostr_server::JSON;
+
+///Same framing as Peer::send_event
+static std::string frame_event(std::string_view sub_id, std::string_view event_json) {
+    std::string json;
+    std::string id = JSON(sub_id).to_json(JSON::flagUTF8);
+    json.reserve(event_json.size()+id.size()+12);
+    json.append("[\"EVENT\",").append(id).append(",").append(event_json).append("]");
+    return json;
+}
+
+///Fan-out of one event to many subscribers
+/**
+ * Compares rendering the event per subscriber (toStructured + to_json),
+ * with JSON rendered once by EventSource and framed per subscriber
+ */
+static void bench_broadcast() {
+    constexpr std::size_t events = 200;
+    for (std::size_t subscribers: {1, 10, 100, 1000}) {
+        auto evs = generate_events(events);
+        std::size_t ops = events * subscribers;
+        std::cout << " subscribers: " << subscribers << std::endl;
+        measure("per-subscriber render", ops, [&]{
+            for (const Event &ev: evs) {
+                for (std::size_t i = 0; i < subscribers; ++i) {
+                    JSON msg = {"EVENT", "sub", ev.toStructured()};
+                    sink = sink + msg.to_json(JSON::flagUTF8).size();
+                }
+            }
+        });
+        measure("shared JSON", ops, [&]{
+            for (Event &ev: evs) {
+                EventSource src(std::move(ev), nullptr);
+                for (std::size_t i = 0; i < subscribers; ++i) {
+                    sink = sink + frame_event("sub", src.get_json()).size();
+                }
+            }
+        });
+    }
+}
+
+static Register reg_broadcast("broadcast", &bench_broadcast);
+
+}
@@ -0,0 +1,60 @@
+/*
+ * bench_flat_event.cpp
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#include "bench.h"
+
+#include <nostr_server/flat_event.h>
+
+#include <iterator>
+
+namespace nostr_server_bench {
+
+using nostr_server::EventDocument;
+using nostr_server::EventOrAttachment;
+using nostr_server::FlatEventDocument;
+using nostr_server::FlatEventOrAttachment;
+
+///Decoding of stored events
+/**
+ * Compares Event and FlatEvent decoded from the same records. Reports
+ * decode time, allocations and memory held per decoded event
+ */
+template<typename Doc, typename T>
+static void decode_all(std::string_view label, const std::vector<std::string> &records) {
+    std::vector<T> out;
+    out.reserve(records.size());
+    std::size_t mem = allocated_memory();
+    std::size_t allocs = allocations();
+    measure(std::string(label), records.size(), [&]{
+        for (const std::string &r: records) {
+            auto at = r.begin();
+            out.push_back(Doc::from_binary(at, r.end()));
+        }
+    });
+    std::cout << "    " << static_cast<double>(allocated_memory() - mem) / records.size() << " bytes/event, "
+              << static_cast<double>(allocations() - allocs) / records.size() << " allocations/event" << std::endl;
+    sink = sink + out.size();
+}
+
+static void bench_flat_event() {
+    constexpr std::size_t events = 20000;
+    auto evs = generate_events(events);
+    std::vector<std::string> records;
+    records.reserve(events);
+    for (const Event &ev: evs) {
+        std::string r;
+        EventDocument::to_binary(EventOrAttachment(ev), std::back_inserter(r));
+        records.push_back(std::move(r));
+    }
+    evs.clear();
+    decode_all<EventDocument, EventOrAttachment>("Event", records);
+    decode_all<FlatEventDocument, FlatEventOrAttachment>("FlatEvent", records);
+}
+
+static Register reg_flat_event("flat_event", &bench_flat_event);
+
+}
@@ -0,0 +1,135 @@
+/*
+ * bench_main.cpp
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#include "bench.h"
+
+#include <nostr_server/signature.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+static std::atomic<std::size_t> alloc_counter = 0;
+static std::atomic<std::size_t> alloc_memory = 0;
+static std::atomic<std::size_t> alloc_peak = 0;
+///size of the block is stored before the block, keeps alignment of malloc
+static constexpr std::size_t alloc_header = alignof(std::max_align_t);
+
+void *operator new(std::size_t sz) {
+    ++alloc_counter;
+    std::size_t cur = alloc_memory += sz;
+    std::size_t peak = alloc_peak.load(std::memory_order_relaxed);
+    while (cur > peak && !alloc_peak.compare_exchange_weak(peak, cur, std::memory_order_relaxed));
+    if (auto p = static_cast<char *>(std::malloc(sz + alloc_header))) {
+        *reinterpret_cast<std::size_t *>(p) = sz;
+        return p + alloc_header;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    if (!p) return;
+    char *b = static_cast<char *>(p) - alloc_header;
+    alloc_memory -= *reinterpret_cast<std::size_t *>(b);
+    std::free(b);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    operator delete(p);
+}
+
+namespace nostr_server_bench {
+
+std::size_t allocations() {
+    return alloc_counter.load(std::memory_order_relaxed);
+}
+
+std::size_t allocated_memory() {
+    return alloc_memory.load(std::memory_order_relaxed);
+}
+
+std::size_t peak_memory() {
+    return alloc_peak.load(std::memory_order_relaxed);
+}
+
+void reset_peak_memory() {
+    alloc_peak.store(allocated_memory(), std::memory_order_relaxed);
+}
+
+std::vector<Benchmark> &registry() {
+    static std::vector<Benchmark> r;
+    return r;
+}
+
+std::vector<Event> generate_events(std::size_t count, Event::Kind kind, std::size_t authors) {
+    nostr_server::SignatureTools tools;
+    std::vector<Event::PrivateKey> keys(authors);
+    for (auto &k: keys) {
+        if (!tools.random_private_key(k)) throw std::runtime_error("Failed to generate a key");
+    }
+    std::mt19937 rnd(1);
+    std::vector<Event> out;
+    out.reserve(count);
+    std::time_t now = std::time(nullptr) - static_cast<std::time_t>(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        Event ev;
+        ev.kind = kind;
+        ev.created_at = now + static_cast<std::time_t>(i);
+        ev.content = "Benchmark note #" + std::to_string(i) + " with some \"quoted\" text,\n"
+                     "a new line and non-ASCII characters: \xC5\xBElu\xC5\xA5ou\xC4\x8Dk\xC3\xBD k\xC5\xAF\xC5\x88";
+        if (i) {
+            const Event &ref = out[rnd() % out.size()];
+            ev.tags.push_back({"e", ref.id.to_hex(), {"", "reply"}});
+            ev.tags.push_back({"p", ref.author.to_hex(), {}});
+        }
+        ev.tags.push_back({"t", "bench", {}});
+        if (!ev.sign(tools, keys[i % authors])) throw std::runtime_error("Failed to sign an event");
+        out.push_back(std::move(ev));
+    }
+    return out;
+}
+
+nostr_server::Config TempApp::default_config() {
+    nostr_server::Config cfg;
+    cfg.threads = 2;
+    cfg.result_cache_size = 0;
+    cfg.recent_count = 0;
+    cfg.event_cache_size = 0;
+    cfg.leveldb_options.create_if_missing = true;
+    return cfg;
+}
+
+TempApp::TempApp(std::string_view name, nostr_server::Config cfg)
+    :_path(std::filesystem::temp_directory_path() / std::string(name)) {
+    std::filesystem::remove_all(_path);
+    cfg.database_path = _path.string();
+    _app = std::make_shared<nostr_server::App>(cfg);
+}
+
+TempApp::~TempApp() {
+    _app.reset();
+    std::error_code ec;
+    std::filesystem::remove_all(_path, ec);
+}
+
+}
+
+int main(int argc, char **argv) {
+    using namespace nostr_server_bench;
+    for (const Benchmark &b: registry()) {
+        bool run = argc < 2;
+        for (int i = 1; i < argc && !run; ++i) run = b.name == argv[i];
+        if (!run) continue;
+        std::cout << b.name << std::endl;
+        b.fn();
+    }
+    return 0;
+}
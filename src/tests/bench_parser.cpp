@@ -0,0 +1,62 @@
+/*
+ * bench_parser.cpp
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#include "bench.h"
+
+#include <nostr_server/message_parser.h>
+
+#include <docdb/structured_document.h>
+
+namespace nostr_server_bench {
+
+using nostr_server::MessageParser;
+
+///Parsing of EVENT messages
+/**
+ * Compares DOM parser (Structured::from_json + Event::fromStructured) with
+ * the direct MessageParser. Reports throughput in MB/s and count of
+ * allocations per event
+ */
+static void bench_parser() {
+    constexpr std::size_t events = 20000;
+    auto evs = generate_events(events);
+    std::vector<std::string> msgs;
+    std::size_t bytes = 0;
+    msgs.reserve(events);
+    for (const Event &ev: evs) {
+        msgs.push_back("[\"EVENT\"," + ev.toJSON() + "]");
+        bytes += msgs.back().size();
+    }
+    auto report = [&](double sec, std::size_t allocs) {
+        std::cout << "    " << bytes / sec / 1048576.0 << " MB/s, "
+                  << static_cast<double>(allocs) / events << " allocations/event" << std::endl;
+    };
+
+    std::size_t a = allocations();
+    double sec = measure("DOM parser", events, [&]{
+        for (const std::string &m: msgs) {
+            auto doc = docdb::Structured::from_json(m);
+            Event ev = Event::fromStructured(doc[1]);
+            sink = sink + ev.content.size();
+        }
+    });
+    report(sec, allocations() - a);
+
+    a = allocations();
+    sec = measure("MessageParser", events, [&]{
+        for (const std::string &m: msgs) {
+            Event ev;
+            std::string_view id;
+            if (MessageParser::parse_event(m, ev, id)) sink = sink + ev.content.size();
+        }
+    });
+    report(sec, allocations() - a);
+}
+
+static Register reg_parser("parser", &bench_parser);
+
+}
@@ -0,0 +1,74 @@
+/*
+ * bench_query.cpp
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#include "bench.h"
+
+namespace nostr_server_bench {
+
+using nostr_server::Filter;
+using nostr_server::IApp;
+
+///Queries with limit
+/**
+ * Compares RecordSetCalculator, which materializes all candidates
+ * (find_in_index), with lazy cursors which stop at the limit (find_newest).
+ * Reports latency and peak memory of a query
+ */
+static void bench_query() {
+    constexpr std::size_t events = 50000;
+    constexpr std::size_t queries = 200;
+    constexpr std::size_t limit = 100;
+    TempApp app("nostr_server_bench_query", TempApp::default_config());
+    auto evs = generate_events(events);
+    Event::Pubkey author = evs.back().author;
+    for (Event &ev: evs) app->publish(std::move(ev), nullptr);
+
+    auto make_filters = [&](std::string_view name) {
+        Filter f;
+        if (name == "kinds") {
+            f.kinds.push_back(1);
+        } else if (name == "tag") {
+            f.tags.push_back({'t', {"bench"}});
+        } else {
+            f.authors.push_back({author, static_cast<unsigned char>(author.size())});
+            f.kinds.push_back(1);
+        }
+        f.limit = limit;
+        return std::vector<Filter>{f};
+    };
+
+    for (std::string_view name: {"kinds", "tag", "author+kinds"}) {
+        std::cout << " filter: " << name << std::endl;
+        auto flts = make_filters(name);
+        IApp::RecordSetCalculator calc;
+        reset_peak_memory();
+        std::size_t base = allocated_memory();
+        measure("find_in_index", queries, [&]{
+            for (std::size_t i = 0; i < queries; ++i) {
+                app->find_in_index(calc, flts);
+                sink = sink + calc.top().size();
+            }
+        });
+        std::cout << "    peak memory: " << peak_memory() - base << " bytes" << std::endl;
+        calc.clear();
+
+        IApp::DocIDList result;
+        reset_peak_memory();
+        base = allocated_memory();
+        measure("find_newest", queries, [&]{
+            for (std::size_t i = 0; i < queries; ++i) {
+                app->find_newest(flts, limit, result);
+                sink = sink + result.size();
+            }
+        });
+        std::cout << "    peak memory: " << peak_memory() - base << " bytes" << std::endl;
+    }
+}
+
+static Register reg_query("query", &bench_query);
+
+}
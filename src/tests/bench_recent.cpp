@@ -0,0 +1,48 @@
+/*
+ * bench_recent.cpp
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#include "bench.h"
+
+namespace nostr_server_bench {
+
+using nostr_server::Filter;
+using nostr_server::IApp;
+
+///Newest events of a hot kind
+/**
+ * Compares the query served from the in-memory ring of recent events with
+ * the same query processed by the index (ring disabled). Reports latency
+ * of a query
+ */
+static void bench_recent() {
+    constexpr std::size_t events = 20000;
+    constexpr std::size_t queries = 2000;
+    constexpr std::size_t limit = 100;
+    Filter f;
+    f.kinds.push_back(1);
+    f.limit = limit;
+    std::vector<Filter> flts{f};
+
+    for (std::size_t recent: {std::size_t(0), std::size_t(2000)}) {
+        auto cfg = TempApp::default_config();
+        cfg.recent_kinds = {1};
+        cfg.recent_count = recent;
+        TempApp app("nostr_server_bench_recent", cfg);
+        for (Event &ev: generate_events(events)) app->publish(std::move(ev), nullptr);
+        IApp::DocIDList result;
+        measure(recent?"ring":"index", queries, [&]{
+            for (std::size_t i = 0; i < queries; ++i) {
+                app->find_newest(flts, limit, result);
+                sink = sink + result.size();
+            }
+        });
+    }
+}
+
+static Register reg_recent("recent", &bench_recent);
+
+}
@@ -0,0 +1,67 @@
+/*
+ * bench_replay.cpp
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#include "bench.h"
+
+#include <nostr_server/event_view.h>
+
+#include <iterator>
+
+namespace nostr_server_bench {
+
+using nostr_server::EventDocument;
+using nostr_server::EventOrAttachment;
+using nostr_server::EventView;
+using JSON = docdb::Structured;
+
+///Rendering of stored events during replay
+/**
+ * Compares decoding and rendering by toStructured() with splicing of the
+ * JSON stored with the event (same as Peer::render_stored_event)
+ */
+static void bench_replay() {
+    constexpr std::size_t events = 20000;
+    auto evs = generate_events(events);
+    std::vector<std::string> records;
+    records.reserve(events);
+    EventDocument::OptionsScope opts(EventDocument::Options{true});
+    for (Event &ev: evs) {
+        std::string r;
+        EventDocument::to_binary(EventOrAttachment(ev), std::back_inserter(r));
+        records.push_back(std::move(r));
+    }
+    evs.clear();
+    std::size_t bytes = 0;
+    double sec = measure("toStructured rendering", events, [&]{
+        for (const std::string &r: records) {
+            EventView view(r);
+            auto sevent = view.decode().toStructured();
+            sevent.set("karma", 0);
+            std::string json = sevent.to_json(JSON::flagUTF8);
+            bytes += json.size();
+        }
+    });
+    std::cout << "    " << bytes / sec / 1048576.0 << " MB/s" << std::endl;
+    bytes = 0;
+    sec = measure("stored JSON", events, [&]{
+        for (const std::string &r: records) {
+            EventView view(r);
+            std::string_view stored = view.json();
+            std::string json;
+            json.reserve(stored.size() + 32);
+            json.append(stored.substr(0, stored.size() - 1));
+            json.append(",\"karma\":0}");
+            bytes += json.size();
+        }
+    });
+    std::cout << "    " << bytes / sec / 1048576.0 << " MB/s" << std::endl;
+    sink = sink + bytes;
+}
+
+static Register reg_replay("replay", &bench_replay);
+
+}
@@ -0,0 +1,55 @@
+/*
+ * bench_verifier.cpp
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#include "bench.h"
+
+#include <nostr_server/signature_verifier.h>
+
+#include <memory>
+#include <thread>
+
+namespace nostr_server_bench {
+
+using nostr_server::Dispatcher;
+using nostr_server::SignatureTools;
+using nostr_server::SignatureVerifier;
+
+///Verification of signatures
+/**
+ * Compares verification in the peer (every peer creates own SignatureTools
+ * and verifies inline) with the shared batched SignatureVerifier
+ */
+static void bench_verifier() {
+    constexpr std::size_t events = 4000;
+    constexpr std::size_t peers = 100;
+    auto evs = generate_events(events);
+    measure("inline, context per peer", events, [&]{
+        for (std::size_t p = 0; p < peers; ++p) {
+            SignatureTools tools;
+            for (std::size_t i = p; i < events; i += peers) {
+                sink = sink + evs[i].verify(tools);
+            }
+        }
+    });
+    unsigned int threads = std::max(std::thread::hardware_concurrency(), 1U);
+    for (unsigned int t: {1U, threads}) {
+        Dispatcher disp(1);
+        SignatureVerifier verifier(t, disp);
+        std::vector<std::unique_ptr<cocls::future<bool> > > results;
+        results.reserve(events);
+        measure("batched verifier, threads: " + std::to_string(t), events, [&]{
+            for (const Event &ev: evs) {
+                results.emplace_back(new auto(verifier.verify(ev.id, ev.author, ev.sig)));
+            }
+            for (auto &r: results) sink = sink + r->wait();
+        });
+    }
+}
+
+static Register reg_verifier("verifier", &bench_verifier);
+
+}
@@ -0,0 +1,54 @@
+/*
+ * bench_writer.cpp
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#include "bench.h"
+
+#include <memory>
+
+namespace nostr_server_bench {
+
+///Storing of events
+/**
+ * Compares synchronous publish (one commit per event) with the group
+ * commit of the event writer. Events are submitted at once as if they
+ * were received by many peers, and one by one, as by a single connection,
+ * which waits for the OK before it sends the next event
+ */
+static void bench_writer() {
+    constexpr std::size_t events = 20000;
+
+    {
+        TempApp app("nostr_server_bench_writer", TempApp::default_config());
+        auto evs = generate_events(events);
+        measure("publish (synchronous)", events, [&]{
+            for (Event &ev: evs) app->publish(std::move(ev), nullptr);
+        });
+    }
+    for (std::size_t batch: {std::size_t(0), std::size_t(256)}) {
+        auto cfg = TempApp::default_config();
+        cfg.write_batch = batch;
+        TempApp app("nostr_server_bench_writer", cfg);
+        auto evs = generate_events(events);
+        std::vector<std::unique_ptr<cocls::future<void> > > results;
+        results.reserve(events / 2);
+        measure("write_event, write_batch: " + std::to_string(batch), events / 2, [&]{
+            for (std::size_t i = 0; i < events / 2; ++i) {
+                results.emplace_back(new auto(app->write_event(std::move(evs[i]), nullptr)));
+            }
+            for (auto &r: results) r->wait();
+        });
+        measure("write_event sequential, write_batch: " + std::to_string(batch), events / 2, [&]{
+            for (std::size_t i = events / 2; i < events; ++i) {
+                app->write_event(std::move(evs[i]), nullptr).wait();
+            }
+        });
+    }
+}
+
+static Register reg_writer("writer", &bench_writer);
+
+}
@@ -0,0 +1,149 @@
+/*
+ * test_canonical_hash.cpp
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#include <nostr_server/event.h>
+
+#include <docdb/structured_document.h>
+#include <openssl/sha.h>
+
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using nostr_server::Event;
+
+///Reference implementation - canonical form rendered by the JSON serializer
+static Event::ID calc_id_reference(const Event &ev) {
+    Event::PubkeyHex pubkey_str = ev.author;
+    docdb::Structured::Array tags;
+    for (const auto &t: ev.tags) {
+        docdb::Structured::Array row;
+        row.push_back(std::string_view(t.tag));
+        row.push_back(std::string_view(t.content));
+        for (const auto &x: t.additional_content) row.push_back(std::string_view(x));
+        tags.push_back(std::move(row));
+    }
+    docdb::Structured doc = {
+        0,
+        std::string_view(pubkey_str.data(), pubkey_str.size()),
+        ev.created_at,
+        ev.kind,
+        std::move(tags),
+        std::string_view(ev.content)
+    };
+    std::string data = doc.to_json(docdb::Structured::flagUTF8);
+    Event::ID hash;
+    SHA256(reinterpret_cast<const std::uint8_t *>(data.data()), data.size(), hash.data());
+    return hash;
+}
+
+static int failures = 0;
+
+static void check(const Event &ev, std::string_view name) {
+    if (ev.calc_id() != calc_id_reference(ev)) {
+        std::cerr << "FAILED: " << name << std::endl;
+        ++failures;
+    }
+}
+
+static std::string control_chars() {
+    std::string out;
+    for (int i = 0; i < 0x20; ++i) out.push_back(static_cast<char>(i));
+    return out;
+}
+
+///Events which exercise escaping and structure of the canonical form
+static void test_corpus() {
+    Event base;
+    base.author = Event::Pubkey::from_hex("79be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798");
+    base.created_at = 1700000000;
+    base.kind = 1;
+
+    auto content = [&](std::string_view name, std::string text) {
+        Event ev = base;
+        ev.content = std::move(text);
+        check(ev, name);
+    };
+    content("empty content", "");
+    content("plain text", "hello world");
+    content("quotes and backslash", "\"quoted\" back\\slash \\\" \\\\");
+    content("short escapes", "a\nb\rc\td\be\ff");
+    content("control bytes", control_chars());
+    content("nul inside", std::string("before\0after", 12));
+    content("non-ASCII", "\xC5\xBElu\xC5\xA5ou\xC4\x8Dk\xC3\xBD k\xC5\xAF\xC5\x88 \xE2\x82\xAC \xF0\x9F\x98\x80");
+    content("slash is not escaped", "a/b</script>");
+    //the hasher buffers output, test texts around size of the buffer
+    for (std::size_t sz: {250, 255, 256, 257, 511, 512, 513, 4096}) {
+        content("long content " + std::to_string(sz), std::string(sz, 'x'));
+        content("long escaped content " + std::to_string(sz), std::string(sz, '\n'));
+    }
+
+    {
+        Event ev = base;
+        ev.tags.push_back({"", "", {}});
+        check(ev, "empty tag");
+    }
+    {
+        Event ev = base;
+        ev.tags.push_back({"e", "", {"", ""}});
+        ev.tags.push_back({"p", "abc", {}});
+        ev.tags.push_back({"t", "\"\\\n", {control_chars(), "\xC3\xA1"}});
+        check(ev, "tags with extra content");
+    }
+    {
+        Event ev = base;
+        ev.created_at = 0;
+        ev.kind = 0;
+        check(ev, "zero numbers");
+        ev.kind = 4294967295U;
+        ev.created_at = 4102444800;
+        check(ev, "large numbers");
+    }
+}
+
+///Random events built from characters which need special handling
+static void test_random() {
+    const std::vector<std::string> pieces = {
+        "a", "Z", " ", "\"", "\\", "/", "\n", "\r", "\t", "\b", "\f",
+        std::string(1, '\0'), "\x01", "\x1f", "\x7e", "\xC3\xA1", "\xE2\x82\xAC", "\xF0\x9F\x98\x80"
+    };
+    std::mt19937 rnd(12345);
+    auto text = [&](std::size_t maxlen) {
+        std::string out;
+        std::size_t len = rnd() % (maxlen + 1);
+        for (std::size_t i = 0; i < len; ++i) out.append(pieces[rnd() % pieces.size()]);
+        return out;
+    };
+    for (int i = 0; i < 2000; ++i) {
+        Event ev;
+        for (auto &b: ev.author) b = static_cast<unsigned char>(rnd());
+        ev.created_at = rnd();
+        ev.kind = rnd() % 40000;
+        ev.content = text(rnd() % 2?16:600);
+        std::size_t ntags = rnd() % 6;
+        for (std::size_t t = 0; t < ntags; ++t) {
+            Event::Tag tag{text(3), text(80), {}};
+            std::size_t extra = rnd() % 4;
+            for (std::size_t x = 0; x < extra; ++x) tag.additional_content.push_back(text(20));
+            ev.tags.push_back(std::move(tag));
+        }
+        check(ev, "random event #" + std::to_string(i));
+    }
+}
+
+int main() {
+    test_corpus();
+    test_random();
+    if (failures) {
+        std::cerr << failures << " test(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "OK" << std::endl;
+    return 0;
+}
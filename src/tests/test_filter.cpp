@@ -0,0 +1,148 @@
+/*
+ * test_filter.cpp
+ *
+ *  Created on: 17. 10. 2026
+ *      Author: ondra
+ */
+
+#include <nostr_server/filter.h>
+
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+
+using namespace nostr_server;
+
+///Reference implementation - linear search in the fields of the filter
+template<typename EventType>
+static bool test_reference(const Filter &flt, const EventType &doc) {
+    auto cmp_shorten = [](const auto &v) {
+        return [&](const auto &x) {
+            return std::equal(x.first.begin(), x.first.begin() + x.second, v.begin());
+        };
+    };
+    if (!flt.authors.empty() && std::none_of(flt.authors.begin(), flt.authors.end(), cmp_shorten(doc.author))) return false;
+    if (!flt.ids.empty() && std::none_of(flt.ids.begin(), flt.ids.end(), cmp_shorten(doc.id))) return false;
+    if (!flt.kinds.empty() && std::find(flt.kinds.begin(), flt.kinds.end(), doc.kind) == flt.kinds.end()) return false;
+    for (const auto &[t, contents]: flt.tags) {
+        bool f = std::any_of(contents.begin(), contents.end(), [&](const std::string &c){
+            if constexpr(std::is_same_v<EventType, Event>) return doc.find_indexed_tag(t, c) != nullptr;
+            else return doc.has_indexed_tag(t, c);
+        });
+        if (!f) return false;
+    }
+    if (flt.since.has_value() && doc.created_at < *flt.since) return false;
+    if (flt.until.has_value() && doc.created_at > *flt.until) return false;
+    return true;
+}
+
+static std::mt19937 rnd(42);
+static int failures = 0;
+
+static unsigned int rand(unsigned int n) {return rnd() % n;}
+
+///keys with small alphabet, so prefixes and full keys often match
+static Binary<32> random_key() {
+    Binary<32> k;
+    for (auto &c: k) c = static_cast<unsigned char>(rand(3));
+    return k;
+}
+
+static std::string random_value() {
+    static const char *values[] = {"a","b","c","d","e","f","g","h","ab",""};
+    return values[rand(10)];
+}
+
+static Filter random_filter() {
+    Filter f;
+    unsigned int n = rand(4)?0:rand(8);
+    for (unsigned int i = 0; i < n; ++i) f.authors.push_back({random_key(), static_cast<unsigned char>(rand(3)?rand(33):32)});
+    n = rand(4)?0:rand(4);
+    for (unsigned int i = 0; i < n; ++i) f.ids.push_back({random_key(), static_cast<unsigned char>(rand(33))});
+    //kinds above the bitmap limit are stored separately
+    n = rand(2)?0:rand(5);
+    for (unsigned int i = 0; i < n; ++i) f.kinds.push_back(rand(3)?rand(8):65530+rand(10));
+    //more than 4 values switches to enumeration of tags of the event
+    n = rand(2)?0:rand(3);
+    for (unsigned int i = 0; i < n; ++i) {
+        std::vector<std::string> vals;
+        unsigned int nv = rand(9);
+        for (unsigned int j = 0; j < nv; ++j) vals.push_back(random_value());
+        f.tags.push_back({"pet"[i], std::move(vals)});
+    }
+    if (!rand(4)) f.since = rand(100);
+    if (!rand(4)) f.until = rand(100);
+    return f;
+}
+
+static Event random_event() {
+    Event ev;
+    ev.author = random_key();
+    ev.id = random_key();
+    ev.kind = rand(3)?rand(8):65530+rand(10);
+    ev.created_at = rand(100);
+    unsigned int n = rand(8);
+    for (unsigned int j = 0; j < n; ++j) {
+        ev.tags.push_back({std::string(1, "petx"[rand(4)]) + (rand(8)?"":"y"), random_value(), {}});
+    }
+    ev.build_hash_map();
+    return ev;
+}
+
+static void check(bool result, bool expected, std::string_view what) {
+    if (result != expected) {
+        if (failures < 10) std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+///Compiled filter must return the same result as the reference for all event types
+static void test_differential() {
+    for (int i = 0; i < 50000; ++i) {
+        Filter f = random_filter();
+        for (int j = 0; j < 5; ++j) {
+            Event ev = random_event();
+            FlatEvent fe(ev);
+            std::string record;
+            EventDocument::to_binary(EventOrAttachment(ev), std::back_inserter(record));
+            EventView view(record);
+            check(f.test(ev), test_reference(f, ev), "Event");
+            check(f.test(fe), test_reference(f, fe), "FlatEvent");
+            check(f.test(view), test_reference(f, view), "EventView");
+        }
+    }
+}
+
+///Filter modified after it was tested
+static void test_modification() {
+    for (int i = 0; i < 10000; ++i) {
+        Filter f = random_filter();
+        Event ev = random_event();
+        f.test(ev);
+        //copy starts uncompiled
+        Filter g = f;
+        g.kinds.push_back(ev.kind);
+        if (!g.tags.empty()) g.tags.back().second.push_back(random_value());
+        check(g.test(ev), test_reference(g, ev), "modified copy");
+        Filter h = std::move(g);
+        h.authors.push_back({ev.author, 32});
+        check(h.test(ev), test_reference(h, ev), "modified moved filter");
+        //in place modification requires compile()
+        f.kinds.push_back(ev.kind);
+        f.compile();
+        check(f.test(ev), test_reference(f, ev), "modified and compiled");
+    }
+}
+
+int main() {
+    test_differential();
+    test_modification();
+    if (failures) {
+        std::cerr << failures << " test(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "OK" << std::endl;
+    return 0;
+}